@@ -0,0 +1,50 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../mimpi.h"
+#include "mimpi_err.h"
+#include "test.h"
+
+// Every process checks the result of sums of int32 and maxima of bytes
+// of given count, contributed by all processes.
+int main(int argc, char **argv)
+{
+    MIMPI_Init(false);
+
+    int const world_rank = MIMPI_World_rank();
+    int const world_size = MIMPI_World_size();
+    int const count = argc > 1 ? atoi(argv[1]) : 1000;
+
+    int32_t *send = malloc(count * sizeof(int32_t));
+    int32_t *recv = malloc(count * sizeof(int32_t));
+    uint8_t *bytes = malloc(count);
+    uint8_t *max = malloc(count);
+    test_assert(send != NULL && recv != NULL && bytes != NULL && max != NULL);
+    for (int i = 0; i < count; i++) {
+        send[i] = world_rank * (i % 1000) - i;
+        bytes[i] = (uint8_t)((world_rank * 31 + i) % 251);
+    }
+
+    ASSERT_MIMPI_OK(MIMPI_Allreduce_typed(send, recv, count, MIMPI_INT32, MIMPI_SUM));
+    ASSERT_MIMPI_OK(MIMPI_Allreduce(bytes, max, count, MIMPI_MAX));
+
+    for (int i = 0; i < count; i++) {
+        int32_t sum = 0;
+        uint8_t expected = 0;
+        for (int r = 0; r < world_size; r++) {
+            sum += r * (i % 1000) - i;
+            uint8_t v = (uint8_t)((r * 31 + i) % 251);
+            expected = v > expected ? v : expected;
+        }
+        test_assert(recv[i] == sum);
+        test_assert(max[i] == expected);
+    }
+
+    free(send);
+    free(recv);
+    free(bytes);
+    free(max);
+    MIMPI_Finalize();
+    return test_success();
+}
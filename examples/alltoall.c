@@ -0,0 +1,69 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../mimpi.h"
+#include "mimpi_err.h"
+#include "test.h"
+
+// Byte j of the block sent from rank `from` to rank `to`.
+static char value(int from, int to, int j)
+{
+    return (char)(from * 31 + to * 7 + j % 97);
+}
+
+int main(int argc, char **argv)
+{
+    MIMPI_Init(false);
+
+    int const world_rank = MIMPI_World_rank();
+    int const world_size = MIMPI_World_size();
+    int const count = atoi(argv[1]);
+
+    char *send = malloc((size_t)count * world_size);
+    char *recv = malloc((size_t)count * world_size);
+    for (int r = 0; r < world_size; r++)
+        for (int j = 0; j < count; j++)
+            send[r * count + j] = value(world_rank, r, j);
+
+    ASSERT_MIMPI_OK(MIMPI_Alltoall(send, recv, count));
+    for (int r = 0; r < world_size; r++)
+        for (int j = 0; j < count; j++)
+            test_assert(recv[r * count + j] == value(r, world_rank, j));
+
+    // The block from `from` to `to` has (from + to) % 3 * count / 2 bytes.
+    int *send_counts = malloc(world_size * sizeof(int));
+    int *send_displs = malloc(world_size * sizeof(int));
+    int *recv_counts = malloc(world_size * sizeof(int));
+    int *recv_displs = malloc(world_size * sizeof(int));
+    int send_total = 0, recv_total = 0;
+    for (int r = world_size - 1; r >= 0; r--) {
+        send_counts[r] = (world_rank + r) % 3 * count / 2;
+        send_displs[r] = send_total;
+        send_total += send_counts[r];
+        recv_counts[r] = send_counts[r];
+        recv_displs[r] = recv_total;
+        recv_total += recv_counts[r];
+    }
+    char *sendv = malloc(send_total + 1);
+    char *recvv = malloc(recv_total + 1);
+    for (int r = 0; r < world_size; r++)
+        for (int j = 0; j < send_counts[r]; j++)
+            sendv[send_displs[r] + j] = value(world_rank, r, j);
+
+    ASSERT_MIMPI_OK(MIMPI_Alltoallv(sendv, send_counts, send_displs, recvv, recv_counts, recv_displs));
+    for (int r = 0; r < world_size; r++)
+        for (int j = 0; j < recv_counts[r]; j++)
+            test_assert(recvv[recv_displs[r] + j] == value(r, world_rank, j));
+
+    free(send);
+    free(recv);
+    free(send_counts);
+    free(send_displs);
+    free(recv_counts);
+    free(recv_displs);
+    free(sendv);
+    free(recvv);
+    MIMPI_Finalize();
+    return test_success();
+}
@@ -0,0 +1,99 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../mimpi.h"
+#include "mimpi_err.h"
+#include "test.h"
+
+#define TAG_ORDER 1
+#define TAG_NOTICE 2
+#define TAG_RESULT 3
+
+// Process 0 hands out jobs to all others and collects their results
+// from whichever sends first. Before that it checks that messages from
+// different processes are received in order of their arrival.
+int main(int argc, char **argv)
+{
+    // the first byte names the sender, the last one the job
+    int const count = argc > 1 ? atoi(argv[1]) : 100;
+    int const jobs = argc > 2 ? atoi(argv[2]) : 20;
+    bool const detection = argc > 3 && atoi(argv[3]) != 0;
+    MIMPI_Init(detection);
+
+    int const world_rank = MIMPI_World_rank();
+    int const world_size = MIMPI_World_size();
+    int source = 0;
+    char token = 0;
+
+    if (world_size == 1) {
+        test_assert(MIMPI_Recv_any(&token, 1, TAG_ORDER, &source) == MIMPI_ERROR_REMOTE_FINISHED);
+        test_assert(source == MIMPI_ANY_SOURCE);
+        MIMPI_Finalize();
+        return test_success();
+    }
+
+    uint8_t *data = malloc(count);
+    test_assert(data != NULL);
+
+    if (world_rank == 0) {
+        // every process sends once it is told to and confirms it on another tag,
+        // so the messages arrive in order of ranks
+        for (int i = 1; i < world_size; i++) {
+            ASSERT_MIMPI_OK(MIMPI_Send(&token, 1, i, TAG_ORDER));
+            ASSERT_MIMPI_OK(MIMPI_Recv(&token, 1, i, TAG_NOTICE));
+        }
+        for (int i = 1; i < world_size; i++) {
+            ASSERT_MIMPI_OK(MIMPI_Recv_any(data, count, TAG_ORDER, &source));
+            test_assert(source == i);
+            test_assert(data[0] == (uint8_t)i);
+        }
+
+        // a receive posted before the message arrives
+        MIMPI_Request request;
+        ASSERT_MIMPI_OK(MIMPI_Irecv(data, count, MIMPI_ANY_SOURCE, TAG_ORDER, &request));
+        ASSERT_MIMPI_OK(MIMPI_Send(&token, 1, world_size - 1, TAG_ORDER));
+        ASSERT_MIMPI_OK(MIMPI_Wait(&request));
+        test_assert(data[0] == (uint8_t)(world_size - 1));
+
+        int *next_job = calloc(world_size, sizeof(int));
+        test_assert(next_job != NULL);
+        for (int received = 0; received < (world_size - 1) * jobs; received++) {
+            ASSERT_MIMPI_OK(MIMPI_Recv_any(data, count, TAG_RESULT, &source));
+            test_assert(source > 0 && source < world_size);
+            // messages of one process are still received in order
+            test_assert(data[0] == (uint8_t)source);
+            test_assert(data[count - 1] == (uint8_t)next_job[source]);
+            next_job[source]++;
+        }
+        for (int i = 1; i < world_size; i++) {
+            test_assert(next_job[i] == jobs);
+        }
+        free(next_job);
+
+        test_assert(MIMPI_Recv_any(data, count, TAG_RESULT, &source) == MIMPI_ERROR_REMOTE_FINISHED);
+        test_assert(source == MIMPI_ANY_SOURCE);
+    }
+    else {
+        memset(data, world_rank, count);
+        // large messages may wait for their receive, the notice must not
+        MIMPI_Request request;
+        ASSERT_MIMPI_OK(MIMPI_Recv(&token, 1, 0, TAG_ORDER));
+        ASSERT_MIMPI_OK(MIMPI_Isend(data, count, 0, TAG_ORDER, &request));
+        ASSERT_MIMPI_OK(MIMPI_Send(&token, 1, 0, TAG_NOTICE));
+        ASSERT_MIMPI_OK(MIMPI_Wait(&request));
+        if (world_rank == world_size - 1) {
+            ASSERT_MIMPI_OK(MIMPI_Recv(&token, 1, 0, TAG_ORDER));
+            ASSERT_MIMPI_OK(MIMPI_Send(data, count, 0, TAG_ORDER));
+        }
+        for (int job = 0; job < jobs; job++) {
+            data[count - 1] = (uint8_t)job;
+            ASSERT_MIMPI_OK(MIMPI_Send(data, count, 0, TAG_RESULT));
+        }
+    }
+
+    free(data);
+    MIMPI_Finalize();
+    return test_success();
+}
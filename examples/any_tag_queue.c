@@ -0,0 +1,42 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../mimpi.h"
+#include "mimpi_err.h"
+#include "test.h"
+
+// Process 0 sends messages tagged MIMPI_ANY_TAG in between ones with
+// a tag, process 1 receives them out of order of sending.
+int main(int argc, char **argv)
+{
+    bool const detection = argc > 1 && atoi(argv[1]) != 0;
+    MIMPI_Init(detection);
+
+    int const world_rank = MIMPI_World_rank();
+    int32_t value;
+
+    if (world_rank == 0) {
+        int32_t const values[] = {50, 51, 52, 60, 61, 70};
+        int const tags[] = {5, MIMPI_ANY_TAG, 5, MIMPI_ANY_TAG, 5, MIMPI_ANY_TAG};
+        for (int i = 0; i < 6; i++) {
+            ASSERT_MIMPI_OK(MIMPI_Send(&values[i], sizeof(int32_t), 1, tags[i]));
+        }
+    }
+    else if (world_rank == 1) {
+        ASSERT_MIMPI_OK(MIMPI_Recv(&value, sizeof(int32_t), 0, 5));
+        test_assert(value == 50);
+        ASSERT_MIMPI_OK(MIMPI_Recv(&value, sizeof(int32_t), 0, 5));
+        test_assert(value == 52);
+        ASSERT_MIMPI_OK(MIMPI_Recv(&value, sizeof(int32_t), 0, MIMPI_ANY_TAG));
+        test_assert(value == 51);
+        ASSERT_MIMPI_OK(MIMPI_Recv(&value, sizeof(int32_t), 0, 5));
+        test_assert(value == 61);
+        ASSERT_MIMPI_OK(MIMPI_Recv(&value, sizeof(int32_t), 0, MIMPI_ANY_TAG));
+        test_assert(value == 60);
+        // the last message stays queued until MIMPI_Finalize
+    }
+
+    MIMPI_Finalize();
+    return test_success();
+}
@@ -0,0 +1,72 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../mimpi.h"
+#include "mimpi_err.h"
+#include "test.h"
+
+// Every process sends many small messages to the next one in a ring,
+// interleaved with large ones of the same tag, and checks they arrive
+// in order. Then it waits for a message from the previous one by polling,
+// whose sender holds it back until its explicit flush.
+int main(int argc, char **argv)
+{
+    int const messages = argc > 1 ? atoi(argv[1]) : 1000;
+    bool const detection = argc > 2 && atoi(argv[2]) != 0;
+    MIMPI_Init(detection);
+
+    int const world_rank = MIMPI_World_rank();
+    int const world_size = MIMPI_World_size();
+    int const next = (world_rank + 1) % world_size;
+    int const prev = (world_rank + world_size - 1) % world_size;
+    int const large = 3000;
+
+    uint8_t *buffer = malloc(large);
+    test_assert(buffer != NULL);
+    if (world_size == 1) {
+        ASSERT_MIMPI_OK(MIMPI_Flush());
+        free(buffer);
+        MIMPI_Finalize();
+        return test_success();
+    }
+
+    for (int i = 0; i < messages; i++) {
+        int32_t value = world_rank * messages + i;
+        ASSERT_MIMPI_OK(MIMPI_Send(&value, sizeof(value), next, 1 + i % 3));
+        if (i % 100 == 99) {
+            for (int j = 0; j < large; j++) {
+                buffer[j] = (uint8_t)(i + j);
+            }
+            ASSERT_MIMPI_OK(MIMPI_Send(buffer, large, next, 1));
+        }
+    }
+    for (int i = 0; i < messages; i++) {
+        int32_t value;
+        ASSERT_MIMPI_OK(MIMPI_Recv(&value, sizeof(value), prev, 1 + i % 3));
+        test_assert(value == prev * messages + i);
+        if (i % 100 == 99) {
+            ASSERT_MIMPI_OK(MIMPI_Recv(buffer, large, prev, 1));
+            for (int j = 0; j < large; j++) {
+                test_assert(buffer[j] == (uint8_t)(i + j));
+            }
+        }
+    }
+
+    int32_t token = world_rank;
+    int32_t got = -1;
+    MIMPI_Request recv;
+    ASSERT_MIMPI_OK(MIMPI_Irecv(&got, sizeof(got), prev, 7, &recv));
+    ASSERT_MIMPI_OK(MIMPI_Send(&token, sizeof(token), next, 7));
+    ASSERT_MIMPI_OK(MIMPI_Flush());
+    bool done = false;
+    while (!done) {
+        ASSERT_MIMPI_OK(MIMPI_Test(&recv, &done));
+    }
+    test_assert(got == prev);
+
+    ASSERT_MIMPI_OK(MIMPI_Barrier());
+    free(buffer);
+    MIMPI_Finalize();
+    return test_success();
+}
@@ -0,0 +1,31 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "../mimpi.h"
+#include "mimpi_err.h"
+#include "test.h"
+
+int main(int argc, char **argv)
+{
+    MIMPI_Init(false);
+
+    int const world_rank = MIMPI_World_rank();
+    int const world_size = MIMPI_World_size();
+    int const next = (world_rank + 1) % world_size;
+    int const prev = (world_rank + world_size - 1) % world_size;
+
+    int number = world_rank;
+    ASSERT_MIMPI_OK(MIMPI_Send(&number, sizeof(number), next, 1));
+    ASSERT_MIMPI_OK(MIMPI_Recv(&number, sizeof(number), prev, 1));
+    test_assert(number == prev);
+
+    uint8_t one = 1, sum = 0;
+    ASSERT_MIMPI_OK(MIMPI_Reduce(&one, &sum, 1, MIMPI_SUM, world_size - 1));
+    ASSERT_MIMPI_OK(MIMPI_Bcast(&sum, 1, world_size - 1));
+    test_assert(sum == (uint8_t)world_size);
+
+    ASSERT_MIMPI_OK(MIMPI_Barrier());
+
+    MIMPI_Finalize();
+    return test_success();
+}
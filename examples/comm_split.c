@@ -0,0 +1,95 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../mimpi.h"
+#include "mimpi_err.h"
+#include "test.h"
+
+// Processes form a grid of given width and run collectives in rows
+// and columns at the same time. Columns are ranked in reverse order of world
+// ranks. Process 0 joins no group of the last split.
+int main(int argc, char **argv)
+{
+    MIMPI_Init(false);
+
+    int const world_rank = MIMPI_World_rank();
+    int const world_size = MIMPI_World_size();
+    int const width = argc > 1 ? atoi(argv[1]) : 2;
+    int const count = argc > 2 ? atoi(argv[2]) : 1000;
+
+    MIMPI_Comm row, column, rest;
+    ASSERT_MIMPI_OK(MIMPI_Comm_split(world_rank / width, world_rank, &row));
+    ASSERT_MIMPI_OK(MIMPI_Comm_split(world_rank % width, -world_rank, &column));
+    ASSERT_MIMPI_OK(MIMPI_Comm_split(world_rank == 0 ? -1 : 0, 0, &rest));
+
+    int const row_first = world_rank / width * width;
+    int const row_size = world_size - row_first < width ? world_size - row_first : width;
+    int const column_size = (world_size - 1 - world_rank % width) / width + 1;
+    test_assert(MIMPI_Comm_size(row) == row_size);
+    test_assert(MIMPI_Comm_rank(row) == world_rank - row_first);
+    test_assert(MIMPI_Comm_size(column) == column_size);
+    test_assert(MIMPI_Comm_rank(column) == column_size - 1 - world_rank / width);
+    test_assert((rest == MIMPI_COMM_NULL) == (world_rank == 0));
+    if (rest != MIMPI_COMM_NULL) {
+        test_assert(MIMPI_Comm_size(rest) == world_size - 1);
+        test_assert(MIMPI_Comm_rank(rest) == world_rank - 1);
+    }
+    else {
+        test_assert(MIMPI_Comm_size(rest) == -1 && MIMPI_Comm_rank(rest) == -1);
+    }
+
+    int32_t *own = malloc(count * sizeof(int32_t));
+    int32_t *sum = malloc(count * sizeof(int32_t));
+    uint8_t *data = malloc(count);
+    test_assert(own != NULL && sum != NULL && data != NULL);
+    for (int i = 0; i < count; i++) {
+        own[i] = world_rank + i;
+    }
+
+    ASSERT_MIMPI_OK(MIMPI_Comm_barrier(row));
+    ASSERT_MIMPI_OK(MIMPI_Comm_allreduce(row, own, sum, count, MIMPI_INT32, MIMPI_SUM));
+    for (int i = 0; i < count; i++) {
+        int32_t expected = 0;
+        for (int r = row_first; r < row_first + row_size; r++) {
+            expected += r + i;
+        }
+        test_assert(sum[i] == expected);
+    }
+
+    // the column root is its last process in the world
+    int const column_last = world_rank % width + (column_size - 1) * width;
+    for (int i = 0; i < count; i++) {
+        data[i] = world_rank == column_last ? (uint8_t)(column_last + i) : 0;
+    }
+    test_assert(MIMPI_Comm_bcast(column, data, count, column_size) == MIMPI_ERROR_NO_SUCH_RANK);
+    ASSERT_MIMPI_OK(MIMPI_Comm_bcast(column, data, count, 0));
+    for (int i = 0; i < count; i++) {
+        test_assert(data[i] == (uint8_t)(column_last + i));
+    }
+
+    ASSERT_MIMPI_OK(MIMPI_Comm_reduce(column, own, sum, count, MIMPI_INT32, MIMPI_MAX, column_size - 1));
+    if (world_rank < width) {
+        for (int i = 0; i < count; i++) {
+            test_assert(sum[i] == column_last + i);
+        }
+    }
+
+    if (rest != MIMPI_COMM_NULL) {
+        ASSERT_MIMPI_OK(MIMPI_Comm_allreduce(rest, own, sum, count, MIMPI_INT32, MIMPI_MIN));
+        for (int i = 0; i < count; i++) {
+            test_assert(sum[i] == 1 + i);
+        }
+    }
+    ASSERT_MIMPI_OK(MIMPI_Barrier());
+
+    MIMPI_Comm_free(&row);
+    MIMPI_Comm_free(&column);
+    MIMPI_Comm_free(&rest);
+    test_assert(row == MIMPI_COMM_NULL && column == MIMPI_COMM_NULL && rest == MIMPI_COMM_NULL);
+    free(own);
+    free(sum);
+    free(data);
+    MIMPI_Finalize();
+    return test_success();
+}
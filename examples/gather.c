@@ -0,0 +1,91 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../mimpi.h"
+#include "mimpi_err.h"
+#include "test.h"
+
+// Byte j of the block of rank r.
+static char value(int r, int j)
+{
+    return (char)(r * 37 + j % 101);
+}
+
+int main(int argc, char **argv)
+{
+    MIMPI_Init(false);
+
+    int const world_rank = MIMPI_World_rank();
+    int const world_size = MIMPI_World_size();
+    int const count = atoi(argv[1]);
+    int const root = atoi(argv[2]);
+
+    // Variable sized blocks, the one of rank 1 empty, laid out
+    // in reverse order of ranks.
+    int *counts = malloc(world_size * sizeof(int));
+    int *displs = malloc(world_size * sizeof(int));
+    int total = 0;
+    for (int r = world_size - 1; r >= 0; r--) {
+        counts[r] = r == 1 ? 0 : count + r;
+        displs[r] = total;
+        total += counts[r];
+    }
+
+    char *own = malloc(count + world_size);
+    char *all = malloc((size_t)count * world_size + total);
+    for (int j = 0; j < count + world_size; j++) {
+        own[j] = value(world_rank, j);
+    }
+
+    memset(all, 0, (size_t)count * world_size);
+    ASSERT_MIMPI_OK(MIMPI_Gather(own, all, count, root));
+    if (world_rank == root) {
+        for (int r = 0; r < world_size; r++)
+            for (int j = 0; j < count; j++)
+                test_assert(all[r * count + j] == value(r, j));
+    }
+
+    ASSERT_MIMPI_OK(MIMPI_Allgather(own, all, count));
+    for (int r = 0; r < world_size; r++)
+        for (int j = 0; j < count; j++)
+            test_assert(all[r * count + j] == value(r, j));
+
+    char *block = malloc(count + world_size);
+    ASSERT_MIMPI_OK(MIMPI_Scatter(all, block, count, root));
+    for (int j = 0; j < count; j++)
+        test_assert(block[j] == value(world_rank, j));
+
+    memset(all, 0, total);
+    ASSERT_MIMPI_OK(MIMPI_Gatherv(own, counts[world_rank], all, counts, displs, root));
+    if (world_rank == root) {
+        for (int r = 0; r < world_size; r++)
+            for (int j = 0; j < counts[r]; j++)
+                test_assert(all[displs[r] + j] == value(r, j));
+    }
+
+    ASSERT_MIMPI_OK(MIMPI_Allgatherv(own, counts[world_rank], all, counts, displs));
+    for (int r = 0; r < world_size; r++)
+        for (int j = 0; j < counts[r]; j++)
+            test_assert(all[displs[r] + j] == value(r, j));
+
+    memset(block, 0, count + world_size);
+    ASSERT_MIMPI_OK(MIMPI_Scatterv(all, counts, displs, block, counts[world_rank], root));
+    for (int j = 0; j < counts[world_rank]; j++)
+        test_assert(block[j] == value(world_rank, j));
+
+    // a block bigger than its count is rejected by every process
+    int const wrong = counts[world_rank] + 1;
+    ASSERT_MIMPI_RETCODE(MIMPI_Gatherv(own, wrong, all, counts, displs, root), MIMPI_ERROR_INVALID_ARGUMENT);
+    ASSERT_MIMPI_RETCODE(MIMPI_Allgatherv(own, wrong, all, counts, displs), MIMPI_ERROR_INVALID_ARGUMENT);
+    ASSERT_MIMPI_RETCODE(MIMPI_Scatterv(all, counts, displs, block, wrong, root), MIMPI_ERROR_INVALID_ARGUMENT);
+
+    free(counts);
+    free(displs);
+    free(own);
+    free(all);
+    free(block);
+    MIMPI_Finalize();
+    return test_success();
+}
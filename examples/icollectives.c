@@ -0,0 +1,78 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../mimpi.h"
+#include "mimpi_err.h"
+#include "test.h"
+
+// Processes start a broadcast, a reduction and a barrier without waiting,
+// exchange messages with neighbours in the meantime, then check the results
+// of all of them and of a blocking broadcast started right after.
+int main(int argc, char **argv)
+{
+    MIMPI_Init(false);
+
+    int const world_rank = MIMPI_World_rank();
+    int const world_size = MIMPI_World_size();
+    int const count = argc > 1 ? atoi(argv[1]) : 1000;
+    int const root = world_size - 1;
+
+    uint8_t *bcast = malloc(count);
+    uint8_t *send = malloc(count);
+    uint8_t *recv = malloc(count);
+    uint8_t *after = malloc(count);
+    test_assert(bcast != NULL && send != NULL && recv != NULL && after != NULL);
+    for (int i = 0; i < count; i++) {
+        bcast[i] = world_rank == root ? (uint8_t)(i * 7) : 0;
+        send[i] = (uint8_t)(world_rank + i);
+        after[i] = world_rank == 0 ? (uint8_t)(i * 3) : 0;
+    }
+
+    MIMPI_Request bad = MIMPI_REQUEST_NULL;
+    test_assert(MIMPI_Ibcast(bcast, count, world_size, &bad) == MIMPI_ERROR_NO_SUCH_RANK);
+    test_assert(bad == MIMPI_REQUEST_NULL);
+
+    MIMPI_Request requests[3];
+    ASSERT_MIMPI_OK(MIMPI_Ibcast(bcast, count, root, &requests[0]));
+    ASSERT_MIMPI_OK(MIMPI_Ireduce(send, recv, count, MIMPI_SUM, 0, &requests[1]));
+    ASSERT_MIMPI_OK(MIMPI_Ibarrier(&requests[2]));
+
+    if (world_size > 1) {
+        int next = (world_rank + 1) % world_size;
+        int prev = (world_rank + world_size - 1) % world_size;
+        int token = world_rank;
+        int got = -1;
+        MIMPI_Request token_recv;
+        ASSERT_MIMPI_OK(MIMPI_Irecv(&got, sizeof(got), prev, 5, &token_recv));
+        ASSERT_MIMPI_OK(MIMPI_Send(&token, sizeof(token), next, 5));
+        ASSERT_MIMPI_OK(MIMPI_Wait(&token_recv));
+        test_assert(got == prev);
+    }
+
+    bool done = false;
+    while (!done) {
+        ASSERT_MIMPI_OK(MIMPI_Test(&requests[2], &done));
+    }
+    ASSERT_MIMPI_OK(MIMPI_Waitall(3, requests));
+    ASSERT_MIMPI_OK(MIMPI_Bcast(after, count, 0));
+
+    for (int i = 0; i < count; i++) {
+        test_assert(bcast[i] == (uint8_t)(i * 7));
+        test_assert(after[i] == (uint8_t)(i * 3));
+        if (world_rank == 0) {
+            uint8_t sum = 0;
+            for (int r = 0; r < world_size; r++) {
+                sum += (uint8_t)(r + i);
+            }
+            test_assert(recv[i] == sum);
+        }
+    }
+
+    free(bcast);
+    free(send);
+    free(recv);
+    free(after);
+    MIMPI_Finalize();
+    return test_success();
+}
@@ -0,0 +1,75 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "../mimpi.h"
+#include "mimpi_err.h"
+#include "test.h"
+
+#define TAGS 8
+#define BIG (1 << 20)
+
+static char big_out[BIG];
+static char big_in[BIG];
+
+int main(int argc, char **argv)
+{
+    MIMPI_Init(false);
+
+    int const world_rank = MIMPI_World_rank();
+    int const world_size = MIMPI_World_size();
+    int const next = (world_rank + 1) % world_size;
+    int const prev = (world_rank + world_size - 1) % world_size;
+
+    // Receives are posted before the matching messages are sent,
+    // in the order reverse to the one of sending.
+    int in[TAGS], out[TAGS];
+    MIMPI_Request recvs[TAGS], sends[TAGS];
+    for (int i = 0; i < TAGS; i++) {
+        ASSERT_MIMPI_OK(MIMPI_Irecv(&in[i], sizeof(int), prev, TAGS - i, &recvs[i]));
+    }
+    ASSERT_MIMPI_OK(MIMPI_Barrier());
+    for (int i = 0; i < TAGS; i++) {
+        out[i] = world_rank * 100 + i + 1;
+        ASSERT_MIMPI_OK(MIMPI_Isend(&out[i], sizeof(int), next, i + 1, &sends[i]));
+    }
+
+    int completed = 0;
+    while (completed < TAGS) {
+        int index;
+        bool flag;
+        ASSERT_MIMPI_OK(MIMPI_Testany(TAGS, recvs, &index, &flag));
+        if (flag) {
+            test_assert(index >= 0 && recvs[index] == MIMPI_REQUEST_NULL);
+            test_assert(in[index] == prev * 100 + TAGS - index);
+            completed++;
+        }
+    }
+    int index;
+    bool flag;
+    ASSERT_MIMPI_OK(MIMPI_Testany(TAGS, recvs, &index, &flag));
+    test_assert(flag && index == -1);
+    ASSERT_MIMPI_OK(MIMPI_Waitall(TAGS, sends));
+
+    // A message bigger than a pipe, sent and received in both directions
+    // at once, which would block with MIMPI_Send followed by MIMPI_Recv.
+    memset(big_out, world_rank, BIG);
+    MIMPI_Request big[2];
+    ASSERT_MIMPI_OK(MIMPI_Isend(big_out, BIG, next, TAGS + 1, &big[0]));
+    ASSERT_MIMPI_OK(MIMPI_Irecv(big_in, BIG, prev, TAGS + 1, &big[1]));
+    ASSERT_MIMPI_OK(MIMPI_Wait(&big[1]));
+    ASSERT_MIMPI_OK(MIMPI_Test(&big[1], &flag));
+    test_assert(flag);
+    ASSERT_MIMPI_OK(MIMPI_Wait(&big[0]));
+    for (int i = 0; i < BIG; i++) {
+        test_assert(big_in[i] == (char)prev);
+    }
+
+    MIMPI_Request bad;
+    test_assert(MIMPI_Isend(out, 1, world_rank, 1, &bad) == MIMPI_ERROR_ATTEMPTED_SELF_OP);
+    test_assert(bad == MIMPI_REQUEST_NULL);
+    test_assert(MIMPI_Irecv(in, 1, world_size, 1, &bad) == MIMPI_ERROR_NO_SUCH_RANK);
+
+    MIMPI_Finalize();
+    return test_success();
+}
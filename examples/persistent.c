@@ -0,0 +1,86 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../mimpi.h"
+#include "mimpi_err.h"
+#include "test.h"
+
+// Every process passes a buffer of given size to the next one in a ring
+// in every step, with the same persistent requests started again and again.
+int main(int argc, char **argv)
+{
+    int const count = argc > 1 ? atoi(argv[1]) : 1000;
+    int const steps = argc > 2 ? atoi(argv[2]) : 20;
+    bool const detection = argc > 3 && atoi(argv[3]) != 0;
+    MIMPI_Init(detection);
+
+    int const world_rank = MIMPI_World_rank();
+    int const world_size = MIMPI_World_size();
+    int const next = (world_rank + 1) % world_size;
+    int const prev = (world_rank + world_size - 1) % world_size;
+
+    MIMPI_Request bad;
+    test_assert(MIMPI_Send_init(NULL, 0, world_size, 1, &bad) == MIMPI_ERROR_NO_SUCH_RANK);
+    test_assert(bad == MIMPI_REQUEST_NULL);
+    test_assert(MIMPI_Recv_init(NULL, 0, world_rank, 1, &bad) == MIMPI_ERROR_ATTEMPTED_SELF_OP);
+    test_assert(bad == MIMPI_REQUEST_NULL);
+    if (world_size == 1) {
+        MIMPI_Finalize();
+        return test_success();
+    }
+
+    uint8_t *out = malloc(count);
+    uint8_t *in = malloc(count);
+    test_assert(out != NULL && in != NULL);
+    MIMPI_Request requests[2];
+    ASSERT_MIMPI_OK(MIMPI_Recv_init(in, count, prev, 1, &requests[0]));
+    ASSERT_MIMPI_OK(MIMPI_Send_init(out, count, next, 1, &requests[1]));
+
+    // inactive requests count as completed
+    bool done = false;
+    ASSERT_MIMPI_OK(MIMPI_Test(&requests[0], &done));
+    test_assert(done && requests[0] != MIMPI_REQUEST_NULL);
+    ASSERT_MIMPI_OK(MIMPI_Wait(&requests[1]));
+    test_assert(requests[1] != MIMPI_REQUEST_NULL);
+
+    // only inactive persistent requests can be started
+    test_assert(MIMPI_Start(&bad) == MIMPI_ERROR_INVALID_ARGUMENT);
+    MIMPI_Request once;
+    ASSERT_MIMPI_OK(MIMPI_Isend(NULL, 0, next, 2, &once));
+    test_assert(MIMPI_Start(&once) == MIMPI_ERROR_INVALID_ARGUMENT);
+    ASSERT_MIMPI_OK(MIMPI_Wait(&once));
+    ASSERT_MIMPI_OK(MIMPI_Recv(NULL, 0, prev, 2));
+
+    for (int step = 0; step < steps; step++) {
+        for (int i = 0; i < count; i++) {
+            out[i] = (uint8_t)(world_rank * 7 + step + i);
+        }
+        if (step % 2 == 0) {
+            ASSERT_MIMPI_OK(MIMPI_Startall(2, requests));
+            test_assert(MIMPI_Start(&requests[0]) == MIMPI_ERROR_INVALID_ARGUMENT);
+            ASSERT_MIMPI_OK(MIMPI_Waitall(2, requests));
+        }
+        else {
+            ASSERT_MIMPI_OK(MIMPI_Start(&requests[0]));
+            ASSERT_MIMPI_OK(MIMPI_Start(&requests[1]));
+            done = false;
+            while (!done) {
+                ASSERT_MIMPI_OK(MIMPI_Test(&requests[0], &done));
+            }
+            ASSERT_MIMPI_OK(MIMPI_Wait(&requests[1]));
+        }
+        test_assert(requests[0] != MIMPI_REQUEST_NULL && requests[1] != MIMPI_REQUEST_NULL);
+        for (int i = 0; i < count; i++) {
+            test_assert(in[i] == (uint8_t)(prev * 7 + step + i));
+        }
+    }
+
+    MIMPI_Request_free(&requests[0]);
+    MIMPI_Request_free(&requests[1]);
+    test_assert(requests[0] == MIMPI_REQUEST_NULL && requests[1] == MIMPI_REQUEST_NULL);
+    free(out);
+    free(in);
+    MIMPI_Finalize();
+    return test_success();
+}
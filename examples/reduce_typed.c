@@ -0,0 +1,63 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../mimpi.h"
+#include "mimpi_err.h"
+#include "test.h"
+
+// Odd count, so that every kernel also runs its scalar tail.
+#define COUNT 1003
+
+// Values of rank r are r + i % 7 + 1, small enough for exact products.
+#define CHECK_TYPE(T, DATATYPE)                                                  \
+    do {                                                                         \
+        T send[COUNT], recv[COUNT];                                              \
+        for (int i = 0; i < COUNT; i++) {                                        \
+            send[i] = (T)(world_rank + i % 7 + 1);                               \
+        }                                                                        \
+        for (int op = MIMPI_MAX; op <= MIMPI_PROD; op++) {                       \
+            ASSERT_MIMPI_OK(MIMPI_Reduce_typed(send, recv, COUNT, DATATYPE, op, root)); \
+            if (world_rank != root) {                                            \
+                continue;                                                        \
+            }                                                                    \
+            for (int i = 0; i < COUNT; i++) {                                    \
+                T expected = (T)(i % 7 + 1);                                     \
+                for (int r = 1; r < world_size; r++) {                           \
+                    T v = (T)(r + i % 7 + 1);                                    \
+                    if (op == MIMPI_MAX) expected = v > expected ? v : expected; \
+                    else if (op == MIMPI_MIN) expected = v < expected ? v : expected; \
+                    else if (op == MIMPI_SUM) expected += v;                     \
+                    else expected *= v;                                          \
+                }                                                                \
+                test_assert(recv[i] == expected);                                \
+            }                                                                    \
+        }                                                                        \
+    } while (0)
+
+int main(int argc, char **argv)
+{
+    MIMPI_Init(false);
+
+    int const world_rank = MIMPI_World_rank();
+    int const world_size = MIMPI_World_size();
+    int const root = world_size - 1;
+
+    // invalid arguments get rejected before anything is sent
+    int32_t dummy = 0;
+    ASSERT_MIMPI_RETCODE(MIMPI_Reduce_typed(&dummy, &dummy, 1, (MIMPI_Datatype)5, MIMPI_SUM, root),
+                         MIMPI_ERROR_INVALID_ARGUMENT);
+    ASSERT_MIMPI_RETCODE(MIMPI_Allreduce_typed(&dummy, &dummy, 1, MIMPI_INT32, (MIMPI_Op)-1),
+                         MIMPI_ERROR_INVALID_ARGUMENT);
+    ASSERT_MIMPI_RETCODE(MIMPI_Allreduce_typed(&dummy, &dummy, 600000000, MIMPI_INT32, MIMPI_SUM),
+                         MIMPI_ERROR_INVALID_ARGUMENT);
+
+    CHECK_TYPE(uint8_t, MIMPI_UINT8);
+    CHECK_TYPE(int32_t, MIMPI_INT32);
+    CHECK_TYPE(int64_t, MIMPI_INT64);
+    CHECK_TYPE(float, MIMPI_FLOAT);
+    CHECK_TYPE(double, MIMPI_DOUBLE);
+
+    MIMPI_Finalize();
+    return test_success();
+}
@@ -0,0 +1,56 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include "../mimpi.h"
+#include "mimpi_err.h"
+#include "test.h"
+
+#define MESSAGES 32
+#define BIG (1 << 20)
+
+// Large sends posted long before the receives must not pile up
+// in the receiver's memory.
+static char out[MESSAGES][BIG];
+static char in[BIG];
+
+int main(int argc, char **argv)
+{
+    MIMPI_Init(false);
+
+    int const world_rank = MIMPI_World_rank();
+    int const tag = 5;
+
+    if (world_rank == 0) {
+        MIMPI_Request requests[2 * MESSAGES];
+        int numbers[MESSAGES];
+        for (int i = 0; i < MESSAGES; i++) {
+            memset(out[i], i + 1, BIG);
+            numbers[i] = i;
+            ASSERT_MIMPI_OK(MIMPI_Isend(out[i], BIG, 1, tag, &requests[2 * i]));
+            ASSERT_MIMPI_OK(MIMPI_Isend(&numbers[i], sizeof(int), 1, tag, &requests[2 * i + 1]));
+        }
+        ASSERT_MIMPI_OK(MIMPI_Barrier());
+        ASSERT_MIMPI_OK(MIMPI_Waitall(2 * MESSAGES, requests));
+    }
+    else if (world_rank == 1) {
+        ASSERT_MIMPI_OK(MIMPI_Barrier());
+        for (int i = 0; i < MESSAGES; i++) {
+            int number;
+            ASSERT_MIMPI_OK(MIMPI_Recv(&number, sizeof(int), 0, MIMPI_ANY_TAG));
+            test_assert(number == i);
+            ASSERT_MIMPI_OK(MIMPI_Recv(in, BIG, 0, tag));
+            test_assert(in[0] == i + 1 && in[BIG - 1] == i + 1);
+        }
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        test_assert(usage.ru_maxrss < MESSAGES / 2 * BIG / 1024);
+    }
+    else {
+        ASSERT_MIMPI_OK(MIMPI_Barrier());
+    }
+
+    MIMPI_Finalize();
+    return test_success();
+}
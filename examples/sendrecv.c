@@ -0,0 +1,63 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../mimpi.h"
+#include "mimpi_err.h"
+#include "test.h"
+
+// Every process exchanges halos of given size with both its neighbours
+// in a ring, then process 0 sends a message to all others at once.
+int main(int argc, char **argv)
+{
+    int const count = argc > 1 ? atoi(argv[1]) : 1000;
+    bool const detection = argc > 2 && atoi(argv[2]) != 0;
+    MIMPI_Init(detection);
+
+    int const world_rank = MIMPI_World_rank();
+    int const world_size = MIMPI_World_size();
+    int const next = (world_rank + 1) % world_size;
+    int const prev = (world_rank + world_size - 1) % world_size;
+
+    uint8_t *own = malloc(count);
+    uint8_t *from_prev = malloc(count);
+    uint8_t *from_next = malloc(count);
+    test_assert(own != NULL && from_prev != NULL && from_next != NULL);
+    for (int i = 0; i < count; i++) {
+        own[i] = (uint8_t)(world_rank * 13 + i);
+    }
+
+    if (world_size > 1) {
+        ASSERT_MIMPI_OK(MIMPI_Sendrecv(own, count, next, 1, from_prev, count, prev, 1));
+        ASSERT_MIMPI_OK(MIMPI_Sendrecv(own, count, prev, 2, from_next, count, next, 2));
+        for (int i = 0; i < count; i++) {
+            test_assert(from_prev[i] == (uint8_t)(prev * 13 + i));
+            test_assert(from_next[i] == (uint8_t)(next * 13 + i));
+        }
+    }
+    test_assert(MIMPI_Sendrecv(own, count, world_size, 1, from_prev, count, prev, 1) == MIMPI_ERROR_NO_SUCH_RANK);
+
+    if (world_rank == 0) {
+        int *destinations = malloc(world_size * sizeof(int));
+        test_assert(destinations != NULL);
+        for (int i = 1; i < world_size; i++) {
+            destinations[i - 1] = i;
+        }
+        ASSERT_MIMPI_OK(MIMPI_Send_multi(own, count, destinations, world_size - 1, 3));
+        destinations[0] = 0;
+        test_assert(MIMPI_Send_multi(own, count, destinations, 1, 4) == MIMPI_ERROR_ATTEMPTED_SELF_OP);
+        free(destinations);
+    }
+    else {
+        ASSERT_MIMPI_OK(MIMPI_Recv(from_prev, count, 0, 3));
+        for (int i = 0; i < count; i++) {
+            test_assert(from_prev[i] == (uint8_t)i);
+        }
+    }
+
+    free(own);
+    free(from_prev);
+    free(from_next);
+    MIMPI_Finalize();
+    return test_success();
+}
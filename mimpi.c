@@ -10,6 +10,14 @@
 #include <semaphore.h>
 #include <errno.h>
 #include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 #include "channel.h"
 #include "mimpi.h"
 #include "mimpi_common.h"
@@ -24,64 +32,387 @@ typedef struct metadata metadata;
 #define GR_READY 1
 #define GR_FINALIZE 2
 
+// Large collective payloads travel the tree in segments of this size,
+// so that every level forwards a segment while receiving the next one.
+#define GR_SEGMENT (32 * 1024)
+
+// Tags of control messages used by deadlock detection. A waiting notice
+// carries the number of messages received from the peer so far in its count
+// and is followed by metadata of the awaited message.
+#define TAG_WAITING -1
+#define TAG_DEADLOCK -2
+
+// Channels delay every write by the number of blocks of this many bytes
+// it spans. Writes of at most a block are atomic as well.
+#define CHANNEL_BLOCK 512
+
+// With the shared memory transport, payloads of at least SHM_MIN_PAYLOAD
+// bytes go through the ring of the pair. The channel carries the header
+// and, for every chunk put in the ring, a token with its size.
+#define TAG_SHM_DATA -3
+#define SHM_MIN_PAYLOAD 512
+#define SHM_RETRY_MS 1
+
+// Rendezvous of messages of at least rendezvous_threshold bytes. The sender
+// announces a message with TAG_RTS, followed by metadata {id, tag}, where ids
+// number announcements to the receiver. The receiver answers with TAG_CTS
+// carrying the id in count once a receive matches it, then the sender sends
+// TAG_RTS_DATA with the id in count, followed by the payload.
+#define TAG_RTS -4
+#define TAG_CTS -5
+#define TAG_RTS_DATA -6
+#define RENDEZVOUS_VAR "MIMPI_RENDEZVOUS_THRESHOLD"
+
+// With batching on, sends of messages whose frame and payload fit in a block
+// of the channel complete at once, copied to the batch of their destination.
+// A batch goes out as a single message tagged TAG_BATCH, with the frames and
+// payloads one after another, before anything else is sent to the same
+// destination, once the next message would not fit in it, and before the
+// process waits for anything.
+#define TAG_BATCH -8
+#define BATCH_VAR "MIMPI_BATCH_SIZE"
+
+// Collectives other than the heap tree run over p-p channels. Each of them
+// gets its own tag at or below TAG_COLL, so messages of consecutive
+// collectives never match each other, nor any user receive. TAG_COLL_ABORT
+// tells that collectives of the sender are broken for good: its pending
+// and future collective messages will never come.
+#define TAG_COLL_ABORT -7
+#define TAG_COLL -9
+#define COLL_TAGS (1 << 24)
+// Collectives of communicators take tags below those of the world ones.
+// Groups of one split are disjoint, so they share a slot of COMM_TAGS tags,
+// the slot is given by the number of the split.
+#define COMM_TAGS (1 << 16)
+#define COMM_SLOTS (1 << 14)
+#define COLL_ALG_VAR "MIMPI_COLL_ALG"
+#define COLL_KARY_VAR "MIMPI_COLL_KARY"
+#define COLL_KARY_DEFAULT 4
+// Automatic choice switches bcast and reduce to the ring at this many bytes,
+// given a processor for every process. Segments of a broadcast over p-p
+// channels are received COLL_WINDOW at a time.
+#define COLL_RING_MIN (1 << 20)
+#define COLL_WINDOW 4
+
+#define COLL_BARRIER 0
+#define COLL_BCAST 1
+#define COLL_REDUCE 2
+#define COLL_ALLREDUCE 3
+#define COLL_GATHER 4
+#define COLL_SCATTER 5
+#define COLL_ALLGATHER 6
+#define COLLECTIVES 7
+
+#define ALG_AUTO 0
+#define ALG_HEAP 1
+#define ALG_BINOMIAL 2
+#define ALG_KARY 3
+#define ALG_RING 4
+#define ALG_DISSEMINATION 5
+#define ALGORITHMS 6
+
+// Positions only grow, the ring holds data from tail to head. Head is
+// written only by the sender, tail only by the receiver. A sender blocked
+// on a full ring sleeps on the futex of reads, which the receiver bumps.
+struct shm_ring {
+    size_t head;
+    int sender_waiting;
+    char pad[64 - sizeof(size_t) - sizeof(int)];
+    size_t tail;
+    unsigned reads;
+};
+typedef struct shm_ring shm_ring;
+
+// Every queued message is on two lists of its source's match index:
+// messages with the same (tag, count) and messages with the same count.
+// Messages of collectives are only on the first, MIMPI_ANY_TAG skips them.
+// Messages tagged MIMPI_ANY_TAG are only on the second, which is their
+// (tag, count) list as well.
+#define BY_TAG 0
+#define BY_COUNT 1
+
+// Announced rendezvous messages are queued with rts_id >= 0 and no data.
+// Arrival numbers order messages of all sources, for MIMPI_ANY_SOURCE.
 struct recv_queue {
     metadata meta;
+    int rts_id;
+    unsigned long arrival;
     void* data;
-    struct recv_queue* next;
+    struct recv_queue* prev[2];
+    struct recv_queue* next[2];
 };
 typedef struct recv_queue recv_queue;
 
+// FIFO list of queued messages with given key. Lists with tag MIMPI_ANY_TAG
+// hold all messages of given count, in order of arrival.
+struct match_list {
+    int tag;
+    int count;
+    recv_queue* head;
+    recv_queue* tail;
+    struct match_list* next;
+};
+typedef struct match_list match_list;
+
+// Hash table of match lists of one source.
+struct match_index {
+    match_list** buckets;
+    int bucket_count;
+    int list_count;
+};
+typedef struct match_index match_index;
+
+#define INDEX_INIT_BUCKETS 16
+
 struct sent_queue {
     metadata meta;
+    int seq;
     struct sent_queue* next;
 };
 typedef struct sent_queue sent_q;
 
-struct queue {
-    recv_queue** begin_data_queue;
-    recv_queue** end_data_queue;
+// Kinds of requests. Control requests carry deadlock detection notices,
+// nobody waits for them and they get freed once written. Announcements
+// of rendezvous sends wait for the receiver's answer once written,
+// then they get sent again as ordinary sends of the payload. Requests
+// of non-blocking collectives get completed by the collective thread.
+// Batches are sent like payloads, but freed with the buffer once sent.
+#define REQ_SEND 0
+#define REQ_RECV 1
+#define REQ_CONTROL 2
+#define REQ_RTS 3
+#define REQ_COLL 4
+#define REQ_BATCH 5
+
+// A send or receive in progress. Pending sends wait in the outbox of their
+// destination, posted receives on the posted list of their source.
+// Persistent requests are only freed by MIMPI_Request_free, in between
+// they are started again and again and inactive when not started.
+// Receives from MIMPI_ANY_SOURCE get the rank of the source they matched
+// as their peer. Posting numbers order receives posted to different lists.
+struct MIMPI_Request_s {
+    int kind;
+    int peer;
+    int tag;
+    int count;
+    void* data;
+    metadata frame[2];
+    size_t frame_size;
+    int rts_id;
+    bool posted;
+    bool queued;
+    bool done;
+    bool persistent;
+    bool active;
+    bool any_source;
+    unsigned long order;
+    MIMPI_Retcode result;
+    sem_t done_sem;
+    struct MIMPI_Request_s* prev;
+    struct MIMPI_Request_s* next;
+};
+typedef struct MIMPI_Request_s request;
+
+// Group of processes made by a split of the world. Collectives of the
+// world take NULL for it.
+struct MIMPI_Comm_s {
+    int rank;
+    int size;
+    int* ranks;
+    int tag_base;
+    int seq;
+};
+typedef struct MIMPI_Comm_s communicator;
+
+// Non-blocking collectives run one after another, in order of calls,
+// in the collective thread started by the first of them. A sync operation
+// only completes once all operations queued before it did.
+#define OP_SYNC 0
+#define OP_BARRIER 1
+#define OP_BCAST 2
+#define OP_REDUCE 3
+#define OP_STOP 4
+
+struct coll_op {
+    int kind;
+    const void* send_data;
+    void* data;
+    int count;
+    MIMPI_Op op;
+    int root;
+    request* req;
+    struct coll_op* next;
+};
+typedef struct coll_op coll_op;
+
+// State of communication with one peer. Receiving side is guarded by mutex,
+// its progress thread is the only producer of queued messages, so traffic
+// from different peers never contends for the same lock. Sending side is
+// guarded by send_mutex: every frame written to the peer goes through
+// its outbox, so frames of different requests never interleave.
+struct peer {
     sem_t mutex;
-    sem_t wait;
-    bool* receiver_running;
-    bool waiting;
-    int needed_tag;
-    int needed_source;
-    int needed_count;
-    void* wait_data;
-    int got_data;
-    metadata other_waiting[16];
-    sent_q* sent_queue[16];
+    match_index queue;
+    request* posted_head;
+    request* posted_tail;
+    request* blocked;
+    request* rdv_recvs;
+    int rts_received;
+    bool receiver_running;
+    bool coll_aborted;
+    metadata other_waiting;
+    sent_q* sent_queue;
+    int sent_count;
+    int recv_count;
+
+    sem_t send_mutex;
+    request* out_head;
+    request* out_tail;
+    size_t out_sent;
+    metadata out_token;
+    bool out_polled;
+    bool out_stalled;
+    bool sender_running;
+    struct progress* engine;
+    request* rdv_sends;
+    int rts_sent;
+    char* batch;
+    size_t batch_size;
+};
+typedef struct peer peer;
+
+struct queue {
+    peer* peers;
 };
 typedef struct queue queue;
 
+#define INBOX_BATCH 64
+// The receiving thread reads whatever the channel holds, up to INBOX_STAGE
+// bytes, with one read. Small messages wholly read this way are queued
+// together, at most INBOX_BATCH at a time under one hold of the mutex.
+#define INBOX_STAGE (16 * 1024)
+
+// Reading side of a p-p channel. Messages are read piece by piece,
+// whenever the channel is readable, by the progress thread owning it.
+// A payload matching a posted receive is read directly into its buffer.
+struct inbox {
+    int source;
+    metadata md;
+    size_t got;
+    void* data;
+    bool payload;
+    request* direct;
+    bool waiting_notice;
+    int notice_received;
+    bool rts_notice;
+    int rts_count;
+    bool rdv;
+    bool batch;
+    metadata token;
+    size_t token_got;
+    char* stage;
+    size_t stage_start;
+    size_t stage_end;
+    int pending;
+    metadata pending_md[INBOX_BATCH];
+    void* pending_data[INBOX_BATCH];
+};
+typedef struct inbox inbox;
+
+// Progress thread multiplexing a subset of p-p channels with its own epoll.
+// Outboxes waiting for room in a ring are retried every SHM_RETRY_MS.
+struct progress {
+    pthread_t thread;
+    int epfd;
+    int open_channels;
+    int stalled;
+};
+typedef struct progress progress;
+
+// Per-process arena for small allocations made for every message (queue
+// nodes and payloads up to a channel's atomic block). Each size class
+// carves blocks out of slabs and keeps freed blocks on its own free list.
+struct pool_block {
+    struct pool_block* next;
+};
+typedef struct pool_block pool_block;
+
+struct pool_slab {
+    struct pool_slab* next;
+};
+typedef struct pool_slab pool_slab;
+
+struct pool_class {
+    sem_t mutex;
+    size_t size;
+    pool_block* free;
+    pool_slab* slabs;
+    long hits;
+    long misses;
+};
+typedef struct pool_class pool_class;
+
+#define POOL_STATS_VAR "MIMPI_POOL_STATS"
+#define POOL_MIN_SIZE 16
+#define POOL_MAX_SIZE 512
+#define POOL_CLASSES 6
+#define POOL_SLAB_SIZE (64 * 1024)
+#define POOL_SLAB_HEADER 16
+
+#define PROGRESS_THREADS_VAR "MIMPI_PROGRESS_THREADS"
+#define EPOLL_BATCH 64
+#define EVENT_OUT 1
+#define FLUSH_TIMEOUT_MS 100
+
 static queue rec_data;
+static pool_class pools[POOL_CLASSES];
+static long pool_large;
 static int rank, world_size;
-static pthread_t* rec_threads;
+static inbox* inboxes;
+static progress* engines;
+static int engines_count;
 static bool gr_comm;
 static bool deadlock;
+static char* shm_base;
+static size_t shm_ring_size;
+static int rendezvous_threshold;
+static size_t batch_limit;
+static unsigned long arrival_seq;
+static unsigned long post_seq;
+// Receives from MIMPI_ANY_SOURCE wait on their own list until a message
+// of any source matches them. The mutex is taken after mutexes of peers.
+static sem_t any_mutex;
+static request* any_head;
+static request* any_tail;
+static int any_posted;
+static int open_sources;
+static int coll_alg[COLLECTIVES];
+static int coll_kary;
+static int coll_seq;
+static int comm_splits;
+static long coll_cpus;
+static bool coll_thread_running;
+static pthread_t coll_thread;
+static sem_t coll_queue_mutex;
+static sem_t coll_queue_ready;
+static coll_op* coll_queue_head;
+static coll_op* coll_queue_tail;
 
-// first file descriptor is ZEROFD, there are 4*(world_size-1) channels
-// each (world_size-1) descriptors are in 1 group, in order:
-// p-p in, p-p out, group in, group out.
+// first file descriptor is ZEROFD(world_size), there are 2*(world_size-1)
+// descriptors, each (world_size-1) descriptors are in 1 group, in order:
+// p-p in, p-p out.
 static int ppfdin(int source) {
     if (source > rank) {
         source--;
     }
-    return ZEROFD + source;
+    return ZEROFD(world_size) + source;
 }
 
 static int ppfdout(int dest) {
     if (dest > rank) {
         dest--;
     }
-    return ZEROFD + world_size - 1 + dest;
-}
-
-static int grdatafdout(int dest) {
-    if (dest > rank) {
-        dest--;
-    }
-    return GR_DATA_OUT + dest;
+    return ZEROFD(world_size) + world_size - 1 + dest;
 }
 
 static MIMPI_Retcode trysend(int fd, const void* buf, size_t bcount) {
@@ -97,769 +428,3706 @@ static MIMPI_Retcode trysend(int fd, const void* buf, size_t bcount) {
     return MIMPI_SUCCESS;
 }
 
-static int tryrecv(int fd, void* buf, size_t bcount) {
-    while (bcount > 0) {
+// Reads at most bcount bytes without blocking. Returns number of read bytes,
+// 0 if the channel got closed and -1 if there is nothing to read right now.
+static int recv_available(int fd, void* buf, size_t bcount) {
+    while (true) {
         int byterecv = chrecv(fd, buf, bcount);
-        ASSERT_SYS_OK(byterecv);
-        if (byterecv == 0) {
-            return 0;
+        if (byterecv == -1 && errno == EINTR) {
+            continue;
         }
-        bcount -= byterecv;
-        buf += byterecv;
+        if (byterecv == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return -1;
+        }
+        ASSERT_SYS_OK(byterecv);
+        return byterecv;
     }
-    return 1;
 }
 
-static void add_sent_queue (int dest, metadata md) {
-    sent_q* temp = (sent_q*) malloc(sizeof(sent_q));
-    temp->meta.count = md.count;
-    temp->meta.tag = md.tag;
-    temp->next = rec_data.sent_queue[dest];
-    rec_data.sent_queue[dest] = temp;
+// Writes at most bcount bytes without blocking. Returns number of written
+// bytes, -1 if the channel is full right now and -2 if the reader is gone.
+static int send_available(int fd, const void* buf, size_t bcount) {
+    while (true) {
+        int bytesent = chsend(fd, buf, bcount);
+        if (bytesent == -1 && errno == EINTR) {
+            continue;
+        }
+        if (bytesent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return -1;
+        }
+        if (bytesent == -1 && errno == EPIPE) {
+            return -2;
+        }
+        ASSERT_SYS_OK(bytesent);
+        return bytesent;
+    }
 }
 
-static bool remove_sent (int dest, metadata md) {
-    if (rec_data.sent_queue[dest] == NULL) {
-        return false;
+// Moves a descriptor opened by the library to the range reserved for MIMPI.
+static int private_fd(int fd) {
+    int moved = fcntl(fd, F_DUPFD, MIMPI_FD_MIN);
+    ASSERT_SYS_OK(moved);
+    ASSERT_SYS_OK(close(fd));
+    if (moved >= ZEROFD(world_size)) {
+        fatal("no free descriptors left for MIMPI");
     }
-    sent_q* last = NULL;
-    sent_q* curr = rec_data.sent_queue[dest];
-    while (curr != NULL) {
-        if (curr->meta.count == md.count && curr->meta.tag == md.tag) {
-            if (last == NULL) {
-                rec_data.sent_queue[dest] = NULL;
-            }
-            else {
-                last->next = curr->next;
-            }
-            free(curr);
-            ASSERT_SYS_OK(sem_post(&rec_data.mutex));
+    return moved;
+}
 
-            return true;
-        }
-        last = curr;
-        curr = curr->next;
+static void shm_init() {
+    const char* ring_str = getenv(MIMPI_SHM_VAR);
+    shm_ring_size = ring_str == NULL ? 0 : atol(ring_str);
+    if (shm_ring_size == 0) {
+        return;
+    }
+    shm_base = mmap(NULL, (size_t)world_size * world_size * (MIMPI_SHM_HEADER + shm_ring_size),
+                    PROT_READ | PROT_WRITE, MAP_SHARED, MIMPI_SHM_FD, 0);
+    if (shm_base == MAP_FAILED) {
+        syserr("mmap of shared memory rings failed");
     }
-    return false;
+    ASSERT_SYS_OK(close(MIMPI_SHM_FD));
 }
 
-
-static void write_to_queue(int source, metadata meta, void* data) {
-    sem_wait(&rec_data.mutex);
-    if (rec_data.waiting && meta.count == rec_data.needed_count &&
-        (meta.tag == rec_data.needed_tag || rec_data.needed_tag == 0) && source == rec_data.needed_source) {
-        memcpy(rec_data.wait_data, data, meta.count);
-        rec_data.got_data = 1;
-        rec_data.waiting = false;
-        free(data);
-        sem_post(&rec_data.mutex);
-        sem_post(&rec_data.wait);
-        return;
+static void shm_destroy() {
+    if (shm_ring_size > 0) {
+        ASSERT_SYS_OK(munmap(shm_base, (size_t)world_size * world_size * (MIMPI_SHM_HEADER + shm_ring_size)));
     }
+}
 
-    recv_queue* new = (recv_queue*)malloc(sizeof(recv_queue));
-    assert(new != NULL);
-    new->meta.count = meta.count;
-    new->meta.tag = meta.tag;
-    new->data = data;
-    new->next = NULL;
+static bool via_shm(int count) {
+    return shm_ring_size > 0 && count >= SHM_MIN_PAYLOAD;
+}
+
+static shm_ring* ring_of(int to, int from) {
+    return (shm_ring*)(shm_base + ((size_t)to * world_size + from) * (MIMPI_SHM_HEADER + shm_ring_size));
+}
 
-    if (rec_data.begin_data_queue[source] == NULL) {
-        rec_data.begin_data_queue[source] = new;
+// Copies as much of the buffer as fits into the ring to dest.
+// Returns the number of copied bytes.
+static size_t ring_write(int dest, const char* buf, size_t size) {
+    shm_ring* r = ring_of(dest, rank);
+    char* data = (char*)r + MIMPI_SHM_HEADER;
+    size_t head = r->head;
+    size_t space = shm_ring_size - (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE));
+    if (size > space) {
+        size = space;
     }
-    else {
-        rec_data.end_data_queue[source]->next = new;
+    size_t pos = head & (shm_ring_size - 1);
+    size_t first = size < shm_ring_size - pos ? size : shm_ring_size - pos;
+    memcpy(data + pos, buf, first);
+    memcpy(data, buf + first, size - first);
+    __atomic_store_n(&r->head, head + size, __ATOMIC_RELEASE);
+    return size;
+}
+
+// Takes size bytes, announced by a token, out of the ring from source.
+static void ring_read(int source, char* buf, size_t size) {
+    shm_ring* r = ring_of(rank, source);
+    char* data = (char*)r + MIMPI_SHM_HEADER;
+    size_t tail = r->tail;
+    assert(__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - tail >= size);
+    size_t pos = tail & (shm_ring_size - 1);
+    size_t first = size < shm_ring_size - pos ? size : shm_ring_size - pos;
+    memcpy(buf, data + pos, first);
+    memcpy(buf + first, data, size - first);
+    __atomic_store_n(&r->tail, tail + size, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&r->reads, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&r->sender_waiting, __ATOMIC_SEQ_CST)) {
+        syscall(SYS_futex, &r->reads, FUTEX_WAKE, 1, NULL, NULL, 0);
     }
+}
 
-    rec_data.end_data_queue[source] = new;
+// Sleeps until the receiver takes something out of the full ring to dest,
+// at most SHM_RETRY_MS, so that a finished receiver gets noticed.
+static void ring_wait(int dest) {
+    shm_ring* r = ring_of(dest, rank);
+    unsigned reads = __atomic_load_n(&r->reads, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&r->sender_waiting, 1, __ATOMIC_SEQ_CST);
+    if (r->head - __atomic_load_n(&r->tail, __ATOMIC_SEQ_CST) == shm_ring_size) {
+        struct timespec ts = {0, SHM_RETRY_MS * 1000000};
+        syscall(SYS_futex, &r->reads, FUTEX_WAIT, reads, &ts, NULL, 0);
+    }
+    __atomic_store_n(&r->sender_waiting, 0, __ATOMIC_SEQ_CST);
+}
 
-    sem_post(&rec_data.mutex);
+static void pool_init() {
+    size_t size = POOL_MIN_SIZE;
+    for (int i = 0; i < POOL_CLASSES; i++, size *= 2) {
+        ASSERT_SYS_OK(sem_init(&pools[i].mutex, 0, 1));
+        pools[i].size = size;
+        pools[i].free = NULL;
+        pools[i].slabs = NULL;
+        pools[i].hits = 0;
+        pools[i].misses = 0;
+    }
+    pool_large = 0;
 }
 
+static pool_class* pool_class_of(size_t size) {
+    int i = 0;
+    while (pools[i].size < size) {
+        i++;
+    }
+    return &pools[i];
+}
 
-static void* receiver(void* source) {
-    int id = *(int*)source;
-    free(source);
-    int* retcode = (int*)malloc(sizeof(int));
-    assert(retcode != NULL);
-    while (true) {
-        metadata md;
-        if (tryrecv(ppfdin(id), &md, sizeof(metadata)) == 0) {
-            *retcode = 1;
-            sem_wait(&rec_data.mutex);
-            rec_data.receiver_running[id] = false;
-            sem_post(&rec_data.mutex);
-            if (rec_data.waiting && rec_data.needed_source == id) {
-                sem_post(&rec_data.wait);
-            }
-            ASSERT_SYS_OK(close(ppfdin(id)));
+static void* pool_alloc(size_t size) {
+    if (size > POOL_MAX_SIZE) {
+        __atomic_fetch_add(&pool_large, 1, __ATOMIC_RELAXED);
+        void* res = malloc(size);
+        assert(res != NULL);
+        return res;
+    }
 
-            return retcode;
+    pool_class* c = pool_class_of(size);
+    ASSERT_SYS_OK(sem_wait(&c->mutex));
+    if (c->free != NULL) {
+        c->hits++;
+    }
+    else {
+        c->misses++;
+        pool_slab* slab = (pool_slab*) malloc(POOL_SLAB_SIZE);
+        assert(slab != NULL);
+        slab->next = c->slabs;
+        c->slabs = slab;
+        for (size_t off = POOL_SLAB_HEADER; off + c->size <= POOL_SLAB_SIZE; off += c->size) {
+            pool_block* block = (pool_block*)((char*)slab + off);
+            block->next = c->free;
+            c->free = block;
         }
-        if (md.tag == -1) {
-            tryrecv(ppfdin(id), &md, sizeof(metadata));
-            sem_wait(&rec_data.mutex);
-            if (!remove_sent(id, md)) {
-                if (rec_data.waiting && rec_data.needed_source == id) {
-                    rec_data.got_data = -1;
-                    rec_data.waiting = false;
-                    sem_post(&rec_data.wait);
+    }
+    pool_block* block = c->free;
+    c->free = block->next;
+    ASSERT_SYS_OK(sem_post(&c->mutex));
+    return block;
+}
 
-                }
+// Size has to be the same as passed to pool_alloc.
+static void pool_free(void* ptr, size_t size) {
+    if (ptr == NULL) {
+        return;
+    }
+    if (size > POOL_MAX_SIZE) {
+        free(ptr);
+        return;
+    }
 
-                else {
-                    rec_data.other_waiting[id].count = md.count;
-                    rec_data.other_waiting[id].tag = md.tag;
-                }
-            }
-            sem_post(&rec_data.mutex);
-            continue;
+    pool_class* c = pool_class_of(size);
+    pool_block* block = ptr;
+    ASSERT_SYS_OK(sem_wait(&c->mutex));
+    block->next = c->free;
+    c->free = block;
+    ASSERT_SYS_OK(sem_post(&c->mutex));
+}
+
+static void pool_destroy() {
+    bool stats = getenv(POOL_STATS_VAR) != NULL;
+    for (int i = 0; i < POOL_CLASSES; i++) {
+        pool_class* c = &pools[i];
+        long total = c->hits + c->misses;
+        if (stats && total > 0) {
+            fprintf(stderr, "MIMPI pool of rank %d: %zu B blocks, %ld allocations, %.2f%% hit rate\n",
+                    rank, c->size, total, 100.0 * c->hits / total);
         }
-        if (md.tag == -2) {
-            sem_wait(&rec_data.mutex);
-            rec_data.got_data = -1;
-            rec_data.waiting = false;
-            sem_post(&rec_data.wait);
-            sem_post(&rec_data.mutex);
-            continue;
+        while (c->slabs != NULL) {
+            pool_slab* temp = c->slabs;
+            c->slabs = temp->next;
+            free(temp);
         }
+        ASSERT_SYS_OK(sem_destroy(&c->mutex));
+    }
+    if (stats) {
+        fprintf(stderr, "MIMPI pool of rank %d: %ld allocations above %d B\n", rank, pool_large, POOL_MAX_SIZE);
+    }
+}
 
-        void* data = malloc(md.count);
-        assert(data != NULL);
-        if (tryrecv(ppfdin (id), data, md.count) == 0) {
-            *retcode = 1;
-            sem_wait(&rec_data.mutex);
-            rec_data.receiver_running[id] = false;
-            sem_post(&rec_data.mutex);
-            if (rec_data.waiting && rec_data.needed_source == id) {
-                sem_post(&rec_data.wait);
-            }
-            ASSERT_SYS_OK(close(ppfdin(id)));
-            return retcode;
+static int tryrecv(int fd, void* buf, size_t bcount) {
+    while (bcount > 0) {
+        int byterecv = chrecv(fd, buf, bcount);
+        ASSERT_SYS_OK(byterecv);
+        if (byterecv == 0) {
+            return 0;
         }
-
-        write_to_queue(id, md, data);
+        bcount -= byterecv;
+        buf += byterecv;
     }
+    return 1;
 }
 
-static int take_data(void *data, int count, int source, int tag) {
-    sem_wait(&rec_data.mutex);
-    recv_queue* last = NULL;
-    for (recv_queue* i = rec_data.begin_data_queue[source]; i != NULL;i = i->next) {
-        if (i->meta.count == count && (i->meta.tag == tag || tag == 0)) {
-            memcpy(data, i->data, count);
-
-            if (i == rec_data.begin_data_queue[source]) {
-                rec_data.begin_data_queue[source] = i->next;
-            }
-            if (i == rec_data.end_data_queue[source]) {
-                rec_data.end_data_queue[source] = last;
-            }
+static bool tag_matches(int wanted, int tag) {
+    return wanted == tag || (wanted == MIMPI_ANY_TAG && tag >= 0);
+}
 
-            if (last != NULL) {
-                last->next = i->next;
-            }
+static void add_sent_queue (int dest, metadata md) {
+    peer* p = &rec_data.peers[dest];
+    sent_q* temp = (sent_q*) pool_alloc(sizeof(sent_q));
+    temp->meta.count = md.count;
+    temp->meta.tag = md.tag;
+    temp->seq = p->sent_count++;
+    temp->next = p->sent_queue;
+    p->sent_queue = temp;
+}
 
-            free(i->data);
-            free(i);
-            sem_post(&rec_data.mutex);
-            return 1;
+// Forgets messages the peer has already received and checks whether
+// any message still on its way to the peer satisfies what it waits for.
+static bool remove_sent (int dest, metadata md, int received) {
+    bool in_flight = false;
+    sent_q** curr = &rec_data.peers[dest].sent_queue;
+    while (*curr != NULL) {
+        if ((*curr)->seq < received) {
+            sent_q* temp = *curr;
+            *curr = temp->next;
+            pool_free(temp, sizeof(sent_q));
+            continue;
         }
-        last = i;
+        if ((*curr)->meta.count == md.count && tag_matches(md.tag, (*curr)->meta.tag)) {
+            in_flight = true;
+        }
+        curr = &(*curr)->next;
     }
+    return in_flight;
+}
 
-    return 0;
+
+static unsigned key_hash(int tag, int count) {
+    unsigned h = (unsigned)tag * 0x9E3779B1u ^ (unsigned)count * 0x85EBCA77u;
+    return h ^ (h >> 15);
 }
 
-static int take_from_queue(void *data, int count, int source, int tag) {
-    if (take_data(data, count, source, tag)) {
-        return 1;
-    }
+static void index_init(match_index* idx) {
+    idx->bucket_count = INDEX_INIT_BUCKETS;
+    idx->list_count = 0;
+    idx->buckets = (match_list**) calloc(idx->bucket_count, sizeof(match_list*));
+    assert(idx->buckets != NULL);
+}
 
-    if (deadlock) {
-        if (rec_data.other_waiting[source].tag > -1) {
-            rec_data.other_waiting[source].tag = -1;
-            rec_data.other_waiting[source].count = -1;
-            bool other_running = rec_data.receiver_running[source];
-            sem_post(&rec_data.mutex);
-            metadata md;
-            md.tag = -2;
-            md.count = 1;
-            if (other_running)
-                trysend(ppfdout(source), &md, sizeof(metadata));
-            return MIMPI_ERROR_DEADLOCK_DETECTED;
+static void index_grow(match_index* idx) {
+    int new_count = idx->bucket_count * 2;
+    match_list** new_buckets = (match_list**) calloc(new_count, sizeof(match_list*));
+    assert(new_buckets != NULL);
+    for (int i = 0; i < idx->bucket_count; i++) {
+        match_list* list = idx->buckets[i];
+        while (list != NULL) {
+            match_list* next = list->next;
+            unsigned b = key_hash(list->tag, list->count) & (new_count - 1);
+            list->next = new_buckets[b];
+            new_buckets[b] = list;
+            list = next;
         }
     }
+    free(idx->buckets);
+    idx->buckets = new_buckets;
+    idx->bucket_count = new_count;
+}
 
-
-    if (!rec_data.receiver_running[source]) {
-        sem_post(&rec_data.mutex);
-        return 0;
+// Returns the list with given key, creating it if asked to.
+static match_list* index_find(match_index* idx, int tag, int count, bool create) {
+    unsigned b = key_hash(tag, count) & (idx->bucket_count - 1);
+    for (match_list* list = idx->buckets[b]; list != NULL; list = list->next) {
+        if (list->tag == tag && list->count == count) {
+            return list;
+        }
     }
-
-    rec_data.needed_source = source;
-    rec_data.needed_tag = tag;
-    rec_data.needed_count = count;
-    rec_data.wait_data = data;
-    rec_data.waiting = true;
-    rec_data.got_data = 0;
-    sem_post(&rec_data.mutex);
-
-    if (deadlock) {
-        metadata md;
-        md.tag = -1;
-        md.count = sizeof(metadata);
-        trysend(ppfdout(source), &md, sizeof(metadata));
-        md.tag = tag;
-        md.count = count;
-        trysend(ppfdout(source), &md, sizeof(metadata));
+    if (!create) {
+        return NULL;
     }
 
+    if (idx->list_count >= 2 * idx->bucket_count) {
+        index_grow(idx);
+        b = key_hash(tag, count) & (idx->bucket_count - 1);
+    }
+    match_list* list = (match_list*) pool_alloc(sizeof(match_list));
+    list->tag = tag;
+    list->count = count;
+    list->head = NULL;
+    list->tail = NULL;
+    list->next = idx->buckets[b];
+    idx->buckets[b] = list;
+    idx->list_count++;
+    return list;
+}
 
-    sem_wait(&rec_data.wait);
-
-    sem_wait(&rec_data.mutex);
-    rec_data.waiting = false;
-
-    if (rec_data.got_data == 1) {
-        sem_post(&rec_data.mutex);
-        return 1;
+static void index_drop_list(match_index* idx, match_list* list) {
+    match_list** curr = &idx->buckets[key_hash(list->tag, list->count) & (idx->bucket_count - 1)];
+    while (*curr != list) {
+        curr = &(*curr)->next;
     }
-    else if (rec_data.got_data == 0) {
-        sem_post(&rec_data.mutex);
-        return 0;
+    *curr = list->next;
+    idx->list_count--;
+    pool_free(list, sizeof(match_list));
+}
+
+static void list_append(match_list* list, recv_queue* msg, int kind) {
+    msg->prev[kind] = list->tail;
+    msg->next[kind] = NULL;
+    if (list->tail == NULL) {
+        list->head = msg;
     }
     else {
-        sem_post(&rec_data.mutex);
-        return MIMPI_ERROR_DEADLOCK_DETECTED;
+        list->tail->next[kind] = msg;
     }
+    list->tail = msg;
 }
 
-
-void MIMPI_Init(bool enable_deadlock_detection) {
-    deadlock = enable_deadlock_detection;
-    channels_init();
-    rank = atoi(getenv("MIMPI_RANK"));
-    world_size = atoi(getenv("MIMPI_WORLD_SIZE"));
-    unsetenv("MIMPI_WORLD_SIZE");
-    unsetenv("MIMPI_RANK");
-
-    rec_data.begin_data_queue = (recv_queue**) malloc(world_size * sizeof(recv_queue*));
-    rec_data.end_data_queue = (recv_queue**) malloc(world_size * sizeof(recv_queue*));
-    rec_data.receiver_running = (bool*) malloc(world_size * sizeof(bool));
-    assert(rec_data.begin_data_queue != NULL && rec_data.end_data_queue != NULL && rec_data.receiver_running != NULL);
-    for (int i = 0; i < world_size; i++) {
-        rec_data.begin_data_queue[i] = NULL;
-        rec_data.end_data_queue[i] = NULL;
-        rec_data.receiver_running[i] = true;
-        rec_data.sent_queue[i] = NULL;
-    }
-    ASSERT_SYS_OK(sem_init(&rec_data.mutex, 0, 1));
-    ASSERT_SYS_OK(sem_init(&rec_data.wait, 0, 0));
-    rec_data.waiting = false;
-    rec_data.needed_tag = -1;
-    rec_data.needed_count = -1;
-    rec_data.needed_source = -1;
-
-    gr_comm = true;
-
-    rec_threads = (pthread_t*) malloc(world_size * sizeof(pthread_t));
-    assert(rec_threads != NULL);
-    pthread_attr_t attr;
-    ASSERT_ZERO(pthread_attr_init(&attr));
-    ASSERT_ZERO(pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE));
-
-    for (int i = 0; i < world_size; i++) {
-        rec_data.other_waiting[i].tag = -1;
-        rec_data.other_waiting[i].count = -1;
+static void list_unlink(match_index* idx, match_list* list, recv_queue* msg, int kind) {
+    if (msg->prev[kind] == NULL) {
+        list->head = msg->next[kind];
     }
-
-    for (int i = 0; i < world_size; i++) {
-        if (i != rank) {
-            int* rec_rank = (int*) malloc(sizeof(int));
-            assert(rec_rank != NULL);
-            *rec_rank = i;
-            ASSERT_ZERO(pthread_create(&rec_threads[i], &attr, receiver, rec_rank));
-        }
+    else {
+        msg->prev[kind]->next[kind] = msg->next[kind];
+    }
+    if (msg->next[kind] == NULL) {
+        list->tail = msg->prev[kind];
+    }
+    else {
+        msg->next[kind]->prev[kind] = msg->prev[kind];
+    }
+    if (list->head == NULL) {
+        index_drop_list(idx, list);
     }
 }
 
-void MIMPI_Finalize() {
-    // close sending channels
-    for (int i = 0; i < world_size; i++) {
-        if (i != rank) {
-            ASSERT_SYS_OK(close(ppfdout(i)));
-        }
+static void index_push(match_index* idx, recv_queue* msg) {
+    msg->arrival = __atomic_fetch_add(&arrival_seq, 1, __ATOMIC_RELAXED);
+    if (msg->meta.tag != MIMPI_ANY_TAG) {
+        list_append(index_find(idx, msg->meta.tag, msg->meta.count, true), msg, BY_TAG);
     }
-    // WYSLAC INNYM PROCESOM W GRUPOWEJ ZE SKONCZYLEM DZIALAC
-
-
-    if (gr_comm) {
-        int treepos = rank+1;
-        int root = treepos/2;
-        int leftc = treepos*2;
-        int rightc = treepos*2+1;
-        char comm = GR_FINALIZE;
-        if (root > 0) {
-            trysend(GR_ROOT_OUT, &comm, sizeof(char));
-            ASSERT_SYS_OK(close(GR_ROOT_IN));
-            ASSERT_SYS_OK(close(GR_ROOT_OUT));
-        }
-        if (leftc <= world_size) {
-            trysend(GR_LEFT_OUT, &comm, sizeof(char));
-            ASSERT_SYS_OK(close(GR_LEFT_IN));
-            ASSERT_SYS_OK(close(GR_LEFT_OUT));
-        }
-        if (rightc <= world_size) {
-            trysend(GR_RIGHT_OUT, &comm, sizeof(char));
-            ASSERT_SYS_OK(close(GR_RIGHT_IN));
-            ASSERT_SYS_OK(close(GR_RIGHT_OUT));
-        }
+    if (msg->meta.tag >= MIMPI_ANY_TAG) {
+        list_append(index_find(idx, MIMPI_ANY_TAG, msg->meta.count, true), msg, BY_COUNT);
     }
+}
 
-    ASSERT_SYS_OK(close(GR_DATA_IN));
-    for (int i = 0; i < world_size - 1; i++) {
-        ASSERT_SYS_OK(close(GR_DATA_OUT + i));
+// Removes from the index and returns the earliest message matching
+// given tag and count, or NULL if there is none.
+static recv_queue* index_take(match_index* idx, int tag, int count) {
+    int kind = tag == MIMPI_ANY_TAG ? BY_COUNT : BY_TAG;
+    match_list* list = index_find(idx, tag, count, false);
+    if (list == NULL) {
+        return NULL;
     }
-
-
-    // wait for all threads, then free memory, semaphores
-    for (int i = 0; i < world_size; i++) {
-        if (i != rank) {
-            int* status;
-            ASSERT_ZERO(pthread_join(rec_threads[i], (void**)&status));
-            free(status);
-        }
+    recv_queue* msg = list->head;
+    list_unlink(idx, list, msg, kind);
+    if (msg->meta.tag > MIMPI_ANY_TAG) {
+        match_list* other = kind == BY_TAG ? index_find(idx, MIMPI_ANY_TAG, count, false)
+                                           : index_find(idx, msg->meta.tag, count, false);
+        list_unlink(idx, other, msg, 1 - kind);
     }
+    return msg;
+}
 
-//     free all memory
-    for (int i = 0; i < world_size; i++) {
-        recv_queue* list = rec_data.begin_data_queue[i];
-        while (list != NULL) {
-            free(list->data);
-            recv_queue* temp = list;
-            list = list->next;
-            free(temp);
-        }
-    }
+// Returns the earliest message matching given tag and count, leaving it queued.
+static recv_queue* index_peek(match_index* idx, int tag, int count) {
+    match_list* list = index_find(idx, tag, count, false);
+    return list == NULL ? NULL : list->head;
+}
 
-    for (int i = 0; i < world_size; i++) {
-        sent_q * list = rec_data.sent_queue[i];
+static void index_free(match_index* idx) {
+    for (int i = 0; i < idx->bucket_count; i++) {
+        match_list* list = idx->buckets[i];
         while (list != NULL) {
-            sent_q* temp = list;
+            int kind = list->tag == MIMPI_ANY_TAG ? BY_COUNT : BY_TAG;
+            recv_queue* msg = list->head;
+            while (msg != NULL) {
+                recv_queue* temp = msg;
+                msg = msg->next[kind];
+                if (temp->meta.tag == list->tag) {
+                    pool_free(temp->data, temp->meta.count);
+                    pool_free(temp, sizeof(recv_queue));
+                }
+            }
+            match_list* temp = list;
             list = list->next;
-            free(temp);
+            pool_free(temp, sizeof(match_list));
         }
     }
-    free(rec_data.begin_data_queue);
-    free(rec_data.end_data_queue);
-    free(rec_threads);
-    free(rec_data.receiver_running);
-    ASSERT_SYS_OK(sem_destroy(&rec_data.mutex));
-    ASSERT_SYS_OK(sem_destroy(&rec_data.wait));
+    free(idx->buckets);
+}
 
+// Brings everything a start changes back to its initial state.
+static void restart_request(request* req, int kind) {
+    req->kind = kind;
+    req->frame[0].count = req->count;
+    req->frame[0].tag = req->tag;
+    req->frame_size = sizeof(metadata);
+    req->rts_id = -1;
+    req->posted = false;
+    req->queued = false;
+    req->done = false;
+    req->active = true;
+    req->result = MIMPI_SUCCESS;
+    req->prev = NULL;
+    req->next = NULL;
+}
 
-//    print_open_descriptors();
+static request* new_request(int kind, int peer_rank, int tag, int count, void* data) {
+    request* req = (request*) pool_alloc(sizeof(request));
+    req->peer = peer_rank;
+    req->tag = tag;
+    req->count = count;
+    req->data = data;
+    req->persistent = false;
+    req->any_source = peer_rank == MIMPI_ANY_SOURCE;
+    restart_request(req, kind);
+    if (kind != REQ_CONTROL && kind != REQ_BATCH) {
+        ASSERT_SYS_OK(sem_init(&req->done_sem, 0, 0));
+    }
+    return req;
+}
 
-    channels_finalize();
+// Frees a completed request and returns its result.
+static MIMPI_Retcode finish_request(request* req) {
+    MIMPI_Retcode result = req->result;
+    ASSERT_SYS_OK(sem_destroy(&req->done_sem));
+    pool_free(req, sizeof(request));
+    return result;
 }
 
-int MIMPI_World_size() {
-    return world_size;
+// The request must not be touched by the completing thread afterwards,
+// as the waiting one frees it right after the semaphore gets posted.
+static void complete(request* req, MIMPI_Retcode result) {
+    req->result = result;
+    if (req->kind == REQ_CONTROL) {
+        pool_free(req, sizeof(request));
+        return;
+    }
+    if (req->kind == REQ_BATCH) {
+        free(req->data);
+        pool_free(req, sizeof(request));
+        return;
+    }
+    __atomic_store_n(&req->done, true, __ATOMIC_RELEASE);
+    ASSERT_SYS_OK(sem_post(&req->done_sem));
 }
 
-int MIMPI_World_rank() {
-    return rank;
+static bool is_done(request* req) {
+    return __atomic_load_n(&req->done, __ATOMIC_ACQUIRE);
 }
 
-MIMPI_Retcode MIMPI_Send(
-        void const *data,
-        int count,
-        int destination,
-        int tag
-) {
-    if (destination == rank) {
-        return MIMPI_ERROR_ATTEMPTED_SELF_OP;
+// Posted receives of a peer are matched in the order they were posted.
+static void requests_append(request** head, request** tail, request* req) {
+    req->order = __atomic_fetch_add(&post_seq, 1, __ATOMIC_RELAXED);
+    req->next = NULL;
+    req->prev = *tail;
+    if (*tail == NULL) {
+        *head = req;
+    }
+    else {
+        (*tail)->next = req;
+    }
+    *tail = req;
+}
+
+static void requests_remove(request** head, request** tail, request* req) {
+    if (req->prev == NULL) {
+        *head = req->next;
+    }
+    else {
+        req->prev->next = req->next;
+    }
+    if (req->next == NULL) {
+        *tail = req->prev;
+    }
+    else {
+        req->next->prev = req->prev;
+    }
+}
+
+static request* requests_match(request* head, int tag, int count) {
+    for (request* req = head; req != NULL; req = req->next) {
+        if (req->count == count && tag_matches(req->tag, tag)) {
+            return req;
+        }
+    }
+    return NULL;
+}
+
+static void posted_append(peer* p, request* req) {
+    req->posted = true;
+    requests_append(&p->posted_head, &p->posted_tail, req);
+}
+
+static void posted_remove(peer* p, request* req) {
+    req->posted = false;
+    requests_remove(&p->posted_head, &p->posted_tail, req);
+}
+
+// Takes the receive a message from the source goes to: the earliest posted
+// one matching it, either from this source or from MIMPI_ANY_SOURCE.
+// Has to be called holding the mutex of the source.
+static request* posted_take(peer* p, int source, int tag, int count) {
+    request* req = requests_match(p->posted_head, tag, count);
+    if (__atomic_load_n(&any_posted, __ATOMIC_ACQUIRE) > 0) {
+        ASSERT_SYS_OK(sem_wait(&any_mutex));
+        request* any = requests_match(any_head, tag, count);
+        if (any != NULL && (req == NULL || any->order < req->order)) {
+            requests_remove(&any_head, &any_tail, any);
+            any_posted--;
+            any->peer = source;
+            ASSERT_SYS_OK(sem_post(&any_mutex));
+            return any;
+        }
+        ASSERT_SYS_OK(sem_post(&any_mutex));
+    }
+    if (req != NULL) {
+        posted_remove(p, req);
+    }
+    return req;
+}
+
+// Has to be called holding the mutex of the receive's source.
+static void finish_recv(peer* p, request* req, MIMPI_Retcode result) {
+    if (req->posted) {
+        posted_remove(p, req);
+    }
+    if (p->blocked == req) {
+        p->blocked = NULL;
+    }
+    complete(req, result);
+}
+
+// Watches the channel for writability while the outbox waits for it.
+static void outbox_poll(int dest) {
+    peer* p = &rec_data.peers[dest];
+    bool needed = p->out_head != NULL && p->sender_running && !p->out_stalled;
+    if (needed == p->out_polled) {
+        return;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLOUT;
+    ev.data.u64 = ((uint64_t)dest << 1) | EVENT_OUT;
+    ASSERT_SYS_OK(epoll_ctl(p->engine->epfd, needed ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, ppfdout(dest), &ev));
+    p->out_polled = needed;
+}
+
+static void outbox_stall(int dest, bool stalled) {
+    peer* p = &rec_data.peers[dest];
+    if (p->out_stalled != stalled) {
+        p->out_stalled = stalled;
+        __atomic_fetch_add(&p->engine->stalled, stalled ? 1 : -1, __ATOMIC_RELAXED);
+    }
+}
+
+// A full ring gives no sign of its reader being gone, the channel does.
+static bool reader_gone(int dest) {
+    struct pollfd pfd;
+    pfd.fd = ppfdout(dest);
+    pfd.events = POLLOUT;
+    ASSERT_SYS_OK(poll(&pfd, 1, 0));
+    return pfd.revents & POLLERR;
+}
+
+// Rendezvous sends still waiting for an answer will never get one.
+static void rdv_sends_fail(int dest) {
+    peer* p = &rec_data.peers[dest];
+    while (p->rdv_sends != NULL) {
+        request* req = p->rdv_sends;
+        p->rdv_sends = req->next;
+        complete(req, MIMPI_ERROR_REMOTE_FINISHED);
+    }
+}
+
+static void outbox_fail(int dest) {
+    peer* p = &rec_data.peers[dest];
+    p->sender_running = false;
+    while (p->out_head != NULL) {
+        request* req = p->out_head;
+        p->out_head = req->next;
+        complete(req, MIMPI_ERROR_REMOTE_FINISHED);
+    }
+    p->out_tail = NULL;
+    p->out_sent = 0;
+    p->out_token.count = 0;
+    rdv_sends_fail(dest);
+}
+
+// Writes as much of the outbox as the channel takes without blocking.
+// Has to be called holding send_mutex of the destination.
+static void outbox_progress(int dest) {
+    peer* p = &rec_data.peers[dest];
+    bool stalled = false;
+    while (p->out_head != NULL) {
+        request* req = p->out_head;
+        size_t payload = req->kind == REQ_SEND || req->kind == REQ_BATCH ? req->count : 0;
+        size_t total = req->frame_size + payload;
+        int res;
+        if (p->out_token.count > 0) {
+            // shorter than PIPE_BUF, so it is written whole or not at all
+            res = send_available(ppfdout(dest), &p->out_token, sizeof(metadata));
+            if (res >= 0) {
+                p->out_token.count = 0;
+            }
+        }
+        else if (p->out_sent == total) {
+            p->out_head = req->next;
+            if (p->out_head == NULL) {
+                p->out_tail = NULL;
+            }
+            p->out_sent = 0;
+            req->queued = false;
+            if (req->kind == REQ_RTS) {
+                req->next = p->rdv_sends;
+                p->rdv_sends = req;
+            }
+            else {
+                complete(req, MIMPI_SUCCESS);
+            }
+            continue;
+        }
+        else if (p->out_sent < req->frame_size) {
+            // the frame goes in one write with as much of the payload
+            // as fits in the block, unless the payload goes through the ring
+            char stage[CHANNEL_BLOCK];
+            size_t head = req->frame_size - p->out_sent;
+            size_t body = via_shm(req->count) ? 0 : payload;
+            if (body > CHANNEL_BLOCK - head) {
+                body = CHANNEL_BLOCK - head;
+            }
+            memcpy(stage, (char*)req->frame + p->out_sent, head);
+            if (body > 0) {
+                memcpy(stage + head, req->data, body);
+            }
+            res = send_available(ppfdout(dest), stage, head + body);
+            if (res >= 0) {
+                p->out_sent += res;
+            }
+        }
+        else if (via_shm(req->count)) {
+            size_t copied = ring_write(dest, (char*)req->data + (p->out_sent - req->frame_size), total - p->out_sent);
+            if (copied > 0) {
+                p->out_sent += copied;
+                p->out_token.count = copied;
+                p->out_token.tag = TAG_SHM_DATA;
+                continue;
+            }
+            if (!reader_gone(dest)) {
+                stalled = true;
+                break;
+            }
+            res = -2;
+        }
+        else {
+            res = send_available(ppfdout(dest), (char*)req->data + (p->out_sent - req->frame_size), total - p->out_sent);
+            if (res >= 0) {
+                p->out_sent += res;
+            }
+        }
+
+        if (res == -1) {
+            break;
+        }
+        if (res == -2) {
+            outbox_fail(dest);
+            break;
+        }
+    }
+    outbox_stall(dest, stalled);
+    outbox_poll(dest);
+}
+
+// Waits until the outbox may move forward. Returns at least every timeout_ms.
+static void outbox_sleep(int dest, bool stalled, int timeout_ms) {
+    struct pollfd pfd;
+    pfd.fd = ppfdout(dest);
+    pfd.events = POLLOUT;
+    if (stalled) {
+        ring_wait(dest);
+        return;
+    }
+    int res = poll(&pfd, 1, timeout_ms);
+    if (res == -1 && errno != EINTR) {
+        ASSERT_SYS_OK(res);
+    }
+}
+
+// Has to be called holding send_mutex of the destination.
+static void batch_flush(int dest);
+
+static void outbox_append(int dest, request* req) {
+    peer* p = &rec_data.peers[dest];
+    if (p->batch_size > 0 && req->kind != REQ_BATCH) {
+        batch_flush(dest);
+    }
+    if (!p->sender_running) {
+        complete(req, MIMPI_ERROR_REMOTE_FINISHED);
+        return;
+    }
+    req->queued = true;
+    req->next = NULL;
+    if (p->out_tail == NULL) {
+        p->out_head = req;
+    }
+    else {
+        p->out_tail->next = req;
+    }
+    p->out_tail = req;
+    outbox_progress(dest);
+}
+
+static void outbox_push(int dest, request* req) {
+    peer* p = &rec_data.peers[dest];
+    ASSERT_SYS_OK(sem_wait(&p->send_mutex));
+    outbox_append(dest, req);
+    ASSERT_SYS_OK(sem_post(&p->send_mutex));
+}
+
+// Has to be called holding the send mutex of the destination.
+static void batch_flush(int dest) {
+    peer* p = &rec_data.peers[dest];
+    if (p->batch_size == 0) {
+        return;
+    }
+    request* req = new_request(REQ_BATCH, dest, TAG_BATCH, p->batch_size, p->batch);
+    p->batch = NULL;
+    p->batch_size = 0;
+    outbox_append(dest, req);
+}
+
+static bool batched(int count) {
+    return batch_limit > 0 && sizeof(metadata) + count <= CHANNEL_BLOCK;
+}
+
+// Copies the message to the batch of the destination and completes the send.
+static void batch_append(int dest, request* req) {
+    peer* p = &rec_data.peers[dest];
+    ASSERT_SYS_OK(sem_wait(&p->send_mutex));
+    if (!p->sender_running) {
+        ASSERT_SYS_OK(sem_post(&p->send_mutex));
+        complete(req, MIMPI_ERROR_REMOTE_FINISHED);
+        return;
+    }
+    size_t size = sizeof(metadata) + req->count;
+    if (p->batch_size + size > batch_limit) {
+        batch_flush(dest);
+    }
+    if (p->batch == NULL) {
+        p->batch = malloc(batch_limit > size ? batch_limit : size);
+        assert(p->batch != NULL);
+    }
+    memcpy(p->batch + p->batch_size, req->frame, sizeof(metadata));
+    memcpy(p->batch + p->batch_size + sizeof(metadata), req->data, req->count);
+    p->batch_size += size;
+    ASSERT_SYS_OK(sem_post(&p->send_mutex));
+    complete(req, MIMPI_SUCCESS);
+}
+
+// Sends all batches, so that no message waits in them while the process
+// waits for others.
+static void batch_flush_all() {
+    if (batch_limit == 0) {
+        return;
+    }
+    for (int i = 0; i < world_size; i++) {
+        if (i == rank) {
+            continue;
+        }
+        peer* p = &rec_data.peers[i];
+        ASSERT_SYS_OK(sem_wait(&p->send_mutex));
+        batch_flush(i);
+        ASSERT_SYS_OK(sem_post(&p->send_mutex));
+    }
+}
+
+// The receiver matched an announced message, its payload may go now.
+static void got_cts(int id, int rts_id) {
+    peer* p = &rec_data.peers[id];
+    ASSERT_SYS_OK(sem_wait(&p->send_mutex));
+    request** curr = &p->rdv_sends;
+    while (*curr != NULL && (*curr)->rts_id != rts_id) {
+        curr = &(*curr)->next;
+    }
+    assert(*curr != NULL);
+    request* req = *curr;
+    *curr = req->next;
+    req->kind = REQ_SEND;
+    req->frame[0].count = rts_id;
+    req->frame[0].tag = TAG_RTS_DATA;
+    req->frame_size = sizeof(metadata);
+    outbox_append(id, req);
+    ASSERT_SYS_OK(sem_post(&p->send_mutex));
+}
+
+static void send_control(int dest, int tag, int count, const metadata* awaited) {
+    request* req = new_request(REQ_CONTROL, dest, tag, count, NULL);
+    if (awaited != NULL) {
+        req->frame[1] = *awaited;
+        req->frame_size = 2 * sizeof(metadata);
+    }
+    outbox_push(dest, req);
+}
+
+// Has to be called holding the mutex of the source.
+static void queue_message(int source, metadata meta, void* data) {
+    peer* p = &rec_data.peers[source];
+    if (meta.tag >= 0) {
+        p->recv_count++;
+    }
+    request* req = posted_take(p, source, meta.tag, meta.count);
+    if (req != NULL) {
+        memcpy(req->data, data, meta.count);
+        pool_free(data, meta.count > 0 ? meta.count : 1);
+        finish_recv(p, req, MIMPI_SUCCESS);
+        return;
+    }
+
+    recv_queue* new = (recv_queue*) pool_alloc(sizeof(recv_queue));
+    new->meta.count = meta.count;
+    new->meta.tag = meta.tag;
+    new->rts_id = -1;
+    new->data = data;
+    index_push(&p->queue, new);
+}
+
+static void write_to_queue(int source, metadata meta, void* data) {
+    peer* p = &rec_data.peers[source];
+    sem_wait(&p->mutex);
+    queue_message(source, meta, data);
+    sem_post(&p->mutex);
+}
+
+// Messages of a batch are queued under a single hold of the mutex.
+static void got_batch(int source, char* batch, size_t size) {
+    peer* p = &rec_data.peers[source];
+    sem_wait(&p->mutex);
+    size_t off = 0;
+    while (off < size) {
+        metadata meta;
+        memcpy(&meta, batch + off, sizeof(metadata));
+        off += sizeof(metadata);
+        void* data = pool_alloc(meta.count > 0 ? meta.count : 1);
+        memcpy(data, batch + off, meta.count);
+        off += meta.count;
+        queue_message(source, meta, data);
+    }
+    sem_post(&p->mutex);
+    pool_free(batch, size);
+}
+
+// Has to be called holding the mutex of the source. The caller has to
+// send TAG_CTS for the receive once the mutex is released.
+static void rdv_match(peer* p, request* req, int rts_id) {
+    req->rts_id = rts_id;
+    req->next = p->rdv_recvs;
+    p->rdv_recvs = req;
+}
+
+// An announced message counts as received, its payload comes on demand.
+static void got_rts(int source, int count, metadata md) {
+    peer* p = &rec_data.peers[source];
+    sem_wait(&p->mutex);
+    p->recv_count++;
+    request* req = posted_take(p, source, md.tag, count);
+    if (req != NULL) {
+        rdv_match(p, req, md.count);
+    }
+    else {
+        recv_queue* new = (recv_queue*) pool_alloc(sizeof(recv_queue));
+        new->meta.count = count;
+        new->meta.tag = md.tag;
+        new->rts_id = md.count;
+        new->data = NULL;
+        index_push(&p->queue, new);
+    }
+    sem_post(&p->mutex);
+
+    if (req != NULL) {
+        send_control(source, TAG_CTS, md.count, NULL);
+    }
+}
+
+static request* rdv_take(int source, int rts_id) {
+    peer* p = &rec_data.peers[source];
+    sem_wait(&p->mutex);
+    request** curr = &p->rdv_recvs;
+    while ((*curr)->rts_id != rts_id) {
+        curr = &(*curr)->next;
+    }
+    request* req = *curr;
+    *curr = req->next;
+    sem_post(&p->mutex);
+    return req;
+}
+
+// Completes the posted receive whose buffer the payload was read into.
+static void got_direct(int source, request* req, bool counted) {
+    peer* p = &rec_data.peers[source];
+    sem_wait(&p->mutex);
+    if (!counted && req->tag >= 0) {
+        p->recv_count++;
+    }
+    finish_recv(p, req, MIMPI_SUCCESS);
+    sem_post(&p->mutex);
+}
+
+static void receiver_closed(int id, request* filling) {
+    peer* p = &rec_data.peers[id];
+    sem_wait(&p->mutex);
+    p->receiver_running = false;
+    if (filling != NULL) {
+        finish_recv(p, filling, MIMPI_ERROR_REMOTE_FINISHED);
+    }
+    while (p->posted_head != NULL) {
+        finish_recv(p, p->posted_head, MIMPI_ERROR_REMOTE_FINISHED);
+    }
+    while (p->rdv_recvs != NULL) {
+        request* req = p->rdv_recvs;
+        p->rdv_recvs = req->next;
+        finish_recv(p, req, MIMPI_ERROR_REMOTE_FINISHED);
+    }
+    sem_post(&p->mutex);
+    ASSERT_SYS_OK(close(ppfdin(id)));
+
+    if (__atomic_sub_fetch(&open_sources, 1, __ATOMIC_ACQ_REL) == 0) {
+        ASSERT_SYS_OK(sem_wait(&any_mutex));
+        while (any_head != NULL) {
+            request* req = any_head;
+            requests_remove(&any_head, &any_tail, req);
+            any_posted--;
+            complete(req, MIMPI_ERROR_REMOTE_FINISHED);
+        }
+        ASSERT_SYS_OK(sem_post(&any_mutex));
+    }
+
+    ASSERT_SYS_OK(sem_wait(&p->send_mutex));
+    rdv_sends_fail(id);
+    ASSERT_SYS_OK(sem_post(&p->send_mutex));
+}
+
+static void got_waiting_notice(int id, int received, metadata md) {
+    peer* p = &rec_data.peers[id];
+    sem_wait(&p->mutex);
+    if (!remove_sent(id, md, received)) {
+        if (p->blocked != NULL) {
+            finish_recv(p, p->blocked, MIMPI_ERROR_DEADLOCK_DETECTED);
+        }
+        else {
+            p->other_waiting.count = md.count;
+            p->other_waiting.tag = md.tag;
+        }
+    }
+    sem_post(&p->mutex);
+}
+
+// Collective receives from the peer fail now and whenever posted later.
+static void got_coll_abort(int id) {
+    peer* p = &rec_data.peers[id];
+    sem_wait(&p->mutex);
+    p->coll_aborted = true;
+    request* req = p->posted_head;
+    while (req != NULL) {
+        request* next = req->next;
+        if (req->tag <= TAG_COLL) {
+            finish_recv(p, req, MIMPI_ERROR_REMOTE_FINISHED);
+        }
+        req = next;
+    }
+    sem_post(&p->mutex);
+}
+
+static void got_deadlock_notice(int id) {
+    peer* p = &rec_data.peers[id];
+    sem_wait(&p->mutex);
+    if (p->blocked != NULL) {
+        finish_recv(p, p->blocked, MIMPI_ERROR_DEADLOCK_DETECTED);
+    }
+    sem_post(&p->mutex);
+}
+
+// Handles a complete header, returns true if a payload follows it.
+static bool got_header(inbox* in) {
+    if (in->waiting_notice) {
+        in->waiting_notice = false;
+        got_waiting_notice(in->source, in->notice_received, in->md);
+        return false;
+    }
+    if (in->md.tag == TAG_WAITING) {
+        in->waiting_notice = true;
+        in->notice_received = in->md.count;
+        return false;
+    }
+    if (in->md.tag == TAG_DEADLOCK) {
+        got_deadlock_notice(in->source);
+        return false;
+    }
+    if (in->md.tag == TAG_COLL_ABORT) {
+        got_coll_abort(in->source);
+        return false;
+    }
+    if (in->rts_notice) {
+        in->rts_notice = false;
+        got_rts(in->source, in->rts_count, in->md);
+        return false;
+    }
+    if (in->md.tag == TAG_RTS) {
+        in->rts_notice = true;
+        in->rts_count = in->md.count;
+        return false;
+    }
+    if (in->md.tag == TAG_CTS) {
+        got_cts(in->source, in->md.count);
+        return false;
+    }
+    if (in->md.tag == TAG_BATCH) {
+        in->data = pool_alloc(in->md.count);
+        in->batch = true;
+        return true;
+    }
+    if (in->md.tag == TAG_RTS_DATA) {
+        in->direct = rdv_take(in->source, in->md.count);
+        in->data = in->direct->data;
+        in->md.count = in->direct->count;
+        in->rdv = true;
+        return true;
+    }
+
+    peer* p = &rec_data.peers[in->source];
+    sem_wait(&p->mutex);
+    request* req = posted_take(p, in->source, in->md.tag, in->md.count);
+    if (req != NULL) {
+        in->data = req->data;
+        in->direct = req;
+    }
+    sem_post(&p->mutex);
+
+    if (in->direct == NULL) {
+        in->data = pool_alloc(in->md.count > 0 ? in->md.count : 1);
+    }
+    return true;
+}
+
+// Reads everything the channel holds into the empty stage, if that is more
+// than the wanted bytes. Otherwise they are better read right where they go.
+static void inbox_fill(inbox* in, size_t wanted) {
+    if (in->stage_start < in->stage_end) {
+        return;
+    }
+    int available = 0;
+    ASSERT_SYS_OK(ioctl(ppfdin(in->source), FIONREAD, &available));
+    if ((size_t)available <= wanted) {
+        return;
+    }
+    int res = recv_available(ppfdin(in->source), in->stage, available < INBOX_STAGE ? available : INBOX_STAGE);
+    in->stage_start = 0;
+    in->stage_end = res > 0 ? res : 0;
+}
+
+// Like recv_available on the channel of the source, but served from
+// the stage first.
+static int inbox_read(inbox* in, void* target, size_t size) {
+    inbox_fill(in, size);
+    size_t staged = in->stage_end - in->stage_start;
+    if (staged == 0) {
+        return recv_available(ppfdin(in->source), target, size);
+    }
+    size_t n = size < staged ? size : staged;
+    memcpy(target, in->stage + in->stage_start, n);
+    in->stage_start += n;
+    return n;
+}
+
+// Queues messages taken from the stage, in order of arrival.
+static void inbox_flush(inbox* in) {
+    if (in->pending == 0) {
+        return;
+    }
+    peer* p = &rec_data.peers[in->source];
+    sem_wait(&p->mutex);
+    for (int i = 0; i < in->pending; i++) {
+        queue_message(in->source, in->pending_md[i], in->pending_data[i]);
+    }
+    sem_post(&p->mutex);
+    in->pending = 0;
+}
+
+// Takes a whole ordinary message from the stage, to be queued later
+// by inbox_flush. Returns false if the stage does not start with one.
+static bool inbox_take_staged(inbox* in) {
+    metadata md;
+    size_t staged = in->stage_end - in->stage_start;
+    if (staged < sizeof(metadata)) {
+        return false;
+    }
+    memcpy(&md, in->stage + in->stage_start, sizeof(metadata));
+    if ((md.tag < 0 && md.tag > TAG_COLL) || via_shm(md.count) || staged - sizeof(metadata) < (size_t)md.count) {
+        return false;
+    }
+    if (in->pending == INBOX_BATCH) {
+        inbox_flush(in);
+    }
+    void* data = pool_alloc(md.count > 0 ? md.count : 1);
+    memcpy(data, in->stage + in->stage_start + sizeof(metadata), md.count);
+    in->pending_md[in->pending] = md;
+    in->pending_data[in->pending] = data;
+    in->pending++;
+    in->stage_start += sizeof(metadata) + md.count;
+    return true;
+}
+
+// Whether the inbox has work left that needs no data from the channel:
+// a staged frame, or a payload in the ring that is announced or complete.
+static bool inbox_pending(inbox* in) {
+    if (in->stage_start < in->stage_end) {
+        return true;
+    }
+    return in->payload && via_shm(in->md.count)
+        && (in->token_got == sizeof(metadata) || in->got == (size_t)in->md.count);
+}
+
+// Reads what is available from the source, returns false once it got closed.
+// Whatever got into the stage or the ring is handled before returning,
+// as epoll only tells about data still in the channel.
+static bool inbox_progress(progress* p, inbox* in) {
+    int frames = 0;
+    while (frames < INBOX_BATCH || inbox_pending(in)) {
+        if (!in->payload && in->got == 0 && !in->waiting_notice && !in->rts_notice) {
+            inbox_fill(in, sizeof(metadata));
+            if (inbox_take_staged(in)) {
+                frames++;
+                continue;
+            }
+            inbox_flush(in);
+        }
+
+        void* target;
+        size_t size;
+        size_t* got = &in->got;
+        if (in->payload && via_shm(in->md.count)) {
+            if (in->token_got == sizeof(metadata)) {
+                assert(in->token.tag == TAG_SHM_DATA);
+                ring_read(in->source, (char*)in->data + in->got, in->token.count);
+                in->got += in->token.count;
+                in->token_got = 0;
+                continue;
+            }
+            target = (char*)&in->token + in->token_got;
+            size = in->got < in->md.count ? sizeof(metadata) - in->token_got : 0;
+            got = &in->token_got;
+        }
+        else if (in->payload) {
+            target = in->data + in->got;
+            size = in->md.count - in->got;
+        }
+        else {
+            target = (char*)&in->md + in->got;
+            size = sizeof(metadata) - in->got;
+        }
+
+        if (size > 0) {
+            int res = inbox_read(in, target, size);
+            if (res == -1) {
+                inbox_flush(in);
+                return true;
+            }
+            if (res == 0) {
+                if (in->payload && in->direct == NULL) {
+                    pool_free(in->data, in->md.count > 0 ? in->md.count : 1);
+                }
+                // mimpirun might still hold the channel, so epoll would keep reporting it
+                ASSERT_SYS_OK(epoll_ctl(p->epfd, EPOLL_CTL_DEL, ppfdin(in->source), NULL));
+                receiver_closed(in->source, in->payload ? in->direct : NULL);
+                return false;
+            }
+            *got += res;
+            if (res < size || got == &in->token_got) {
+                continue;
+            }
+        }
+
+        in->got = 0;
+        if (in->payload) {
+            in->payload = false;
+            if (in->direct != NULL) {
+                got_direct(in->source, in->direct, in->rdv);
+                in->direct = NULL;
+                in->rdv = false;
+            }
+            else if (in->batch) {
+                got_batch(in->source, in->data, in->md.count);
+                in->batch = false;
+            }
+            else {
+                write_to_queue(in->source, in->md, in->data);
+            }
+            frames++;
+        }
+        else if (got_header(in)) {
+            in->payload = true;
+        }
+        else if (!in->waiting_notice && !in->rts_notice) {
+            frames++;
+        }
+    }
+    inbox_flush(in);
+    return true;
+}
+
+static void retry_stalled(progress* p) {
+    for (int i = 0; i < world_size; i++) {
+        peer* dest = &rec_data.peers[i];
+        if (i == rank || dest->engine != p) {
+            continue;
+        }
+        ASSERT_SYS_OK(sem_wait(&dest->send_mutex));
+        if (dest->out_stalled) {
+            outbox_progress(i);
+        }
+        ASSERT_SYS_OK(sem_post(&dest->send_mutex));
+    }
+}
+
+static void* progress_engine(void* arg) {
+    progress* p = arg;
+    struct epoll_event events[EPOLL_BATCH];
+    while (p->open_channels > 0) {
+        int timeout = __atomic_load_n(&p->stalled, __ATOMIC_RELAXED) > 0 ? SHM_RETRY_MS : -1;
+        int ready = epoll_wait(p->epfd, events, EPOLL_BATCH, timeout);
+        if (ready == -1 && errno == EINTR) {
+            continue;
+        }
+        ASSERT_SYS_OK(ready);
+        if (timeout != -1) {
+            retry_stalled(p);
+        }
+        for (int i = 0; i < ready; i++) {
+            int id = events[i].data.u64 >> 1;
+            if (events[i].data.u64 & EVENT_OUT) {
+                peer* dest = &rec_data.peers[id];
+                ASSERT_SYS_OK(sem_wait(&dest->send_mutex));
+                outbox_progress(id);
+                ASSERT_SYS_OK(sem_post(&dest->send_mutex));
+            }
+            else if (!inbox_progress(p, &inboxes[id])) {
+                p->open_channels--;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void start_engines() {
+    engines_count = 1;
+    const char* threads_str = getenv(PROGRESS_THREADS_VAR);
+    if (threads_str != NULL && atoi(threads_str) > 0) {
+        engines_count = atoi(threads_str);
+    }
+    if (engines_count > world_size - 1) {
+        engines_count = world_size - 1;
+    }
+
+    inboxes = (inbox*) malloc(world_size * sizeof(inbox));
+    engines = (progress*) malloc((engines_count > 0 ? engines_count : 1) * sizeof(progress));
+    assert(inboxes != NULL && engines != NULL);
+    for (int i = 0; i < engines_count; i++) {
+        engines[i].epfd = private_fd(epoll_create1(0));
+        engines[i].open_channels = 0;
+        engines[i].stalled = 0;
+    }
+
+    for (int i = 0, next = 0; i < world_size; i++) {
+        if (i == rank) {
+            continue;
+        }
+        inboxes[i].source = i;
+        inboxes[i].got = 0;
+        inboxes[i].data = NULL;
+        inboxes[i].payload = false;
+        inboxes[i].direct = NULL;
+        inboxes[i].waiting_notice = false;
+        inboxes[i].rts_notice = false;
+        inboxes[i].rdv = false;
+        inboxes[i].batch = false;
+        inboxes[i].stage = malloc(INBOX_STAGE);
+        assert(inboxes[i].stage != NULL);
+        inboxes[i].stage_start = 0;
+        inboxes[i].stage_end = 0;
+        inboxes[i].pending = 0;
+        inboxes[i].token_got = 0;
+
+        int flags = fcntl(ppfdin(i), F_GETFL);
+        ASSERT_SYS_OK(flags);
+        ASSERT_SYS_OK(fcntl(ppfdin(i), F_SETFL, flags | O_NONBLOCK));
+        flags = fcntl(ppfdout(i), F_GETFL);
+        ASSERT_SYS_OK(flags);
+        ASSERT_SYS_OK(fcntl(ppfdout(i), F_SETFL, flags | O_NONBLOCK));
+
+        progress* p = &engines[next++ % engines_count];
+        rec_data.peers[i].engine = p;
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = (uint64_t)i << 1;
+        ASSERT_SYS_OK(epoll_ctl(p->epfd, EPOLL_CTL_ADD, ppfdin(i), &ev));
+        p->open_channels++;
+    }
+
+    pthread_attr_t attr;
+    ASSERT_ZERO(pthread_attr_init(&attr));
+    ASSERT_ZERO(pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE));
+    for (int i = 0; i < engines_count; i++) {
+        ASSERT_ZERO(pthread_create(&engines[i].thread, &attr, progress_engine, &engines[i]));
+    }
+    ASSERT_ZERO(pthread_attr_destroy(&attr));
+}
+
+static void stop_engines() {
+    for (int i = 0; i < engines_count; i++) {
+        ASSERT_ZERO(pthread_join(engines[i].thread, NULL));
+        ASSERT_SYS_OK(close(engines[i].epfd));
+    }
+    free(engines);
+    for (int i = 0; i < world_size; i++) {
+        if (i != rank) {
+            free(inboxes[i].stage);
+        }
+    }
+    free(inboxes);
+}
+
+// Matches the receive against queued messages, posts it if none matches.
+// Takes the message that arrived first among the earliest matching ones
+// of all sources, holding mutexes of all of them. Posts the receive on
+// the list of MIMPI_ANY_SOURCE if none matches.
+static void post_recv_any(request* req) {
+    req->peer = MIMPI_ANY_SOURCE;
+    for (int i = 0; i < world_size; i++) {
+        if (i != rank) {
+            sem_wait(&rec_data.peers[i].mutex);
+        }
+    }
+    int source = -1;
+    recv_queue* first = NULL;
+    bool running = false;
+    for (int i = 0; i < world_size; i++) {
+        if (i == rank) {
+            continue;
+        }
+        peer* p = &rec_data.peers[i];
+        recv_queue* msg = index_peek(&p->queue, req->tag, req->count);
+        if (msg != NULL && (first == NULL || msg->arrival < first->arrival)) {
+            first = msg;
+            source = i;
+        }
+        running |= p->receiver_running;
+    }
+
+    int rts_id = -1;
+    if (first != NULL) {
+        peer* p = &rec_data.peers[source];
+        recv_queue* msg = index_take(&p->queue, req->tag, req->count);
+        req->peer = source;
+        if (msg->rts_id >= 0) {
+            rts_id = msg->rts_id;
+            rdv_match(p, req, rts_id);
+        }
+        else {
+            memcpy(req->data, msg->data, req->count);
+            pool_free(msg->data, req->count > 0 ? req->count : 1);
+            complete(req, MIMPI_SUCCESS);
+        }
+        pool_free(msg, sizeof(recv_queue));
+    }
+    else if (!running) {
+        complete(req, MIMPI_ERROR_REMOTE_FINISHED);
+    }
+    else {
+        ASSERT_SYS_OK(sem_wait(&any_mutex));
+        requests_append(&any_head, &any_tail, req);
+        any_posted++;
+        ASSERT_SYS_OK(sem_post(&any_mutex));
+    }
+
+    for (int i = world_size - 1; i >= 0; i--) {
+        if (i != rank) {
+            sem_post(&rec_data.peers[i].mutex);
+        }
+    }
+    if (rts_id >= 0) {
+        send_control(source, TAG_CTS, rts_id, NULL);
+    }
+}
+
+static void post_recv(request* req) {
+    if (req->any_source) {
+        post_recv_any(req);
+        return;
+    }
+    peer* p = &rec_data.peers[req->peer];
+    sem_wait(&p->mutex);
+    recv_queue* msg = index_take(&p->queue, req->tag, req->count);
+    if (msg != NULL && msg->rts_id >= 0) {
+        int rts_id = msg->rts_id;
+        pool_free(msg, sizeof(recv_queue));
+        rdv_match(p, req, rts_id);
+        sem_post(&p->mutex);
+        send_control(req->peer, TAG_CTS, rts_id, NULL);
+        return;
+    }
+    if (msg != NULL) {
+        memcpy(req->data, msg->data, req->count);
+        pool_free(msg->data, req->count > 0 ? req->count : 1);
+        pool_free(msg, sizeof(recv_queue));
+        complete(req, MIMPI_SUCCESS);
+    }
+    else if (!p->receiver_running || (req->tag <= TAG_COLL && p->coll_aborted)) {
+        complete(req, MIMPI_ERROR_REMOTE_FINISHED);
+    }
+    else {
+        posted_append(p, req);
+    }
+    sem_post(&p->mutex);
+}
+
+// Tells the source what the process is about to wait for, unless the source
+// already waits for this process, which means a deadlock.
+static void block_on_recv(request* req) {
+    peer* p = &rec_data.peers[req->peer];
+    sem_wait(&p->mutex);
+    if (req->done || !req->posted) {
+        sem_post(&p->mutex);
+        return;
+    }
+
+    if (p->other_waiting.tag > -1) {
+        p->other_waiting.tag = -1;
+        p->other_waiting.count = -1;
+        bool other_running = p->receiver_running;
+        finish_recv(p, req, MIMPI_ERROR_DEADLOCK_DETECTED);
+        sem_post(&p->mutex);
+        if (other_running) {
+            send_control(req->peer, TAG_DEADLOCK, 1, NULL);
+        }
+        return;
+    }
+
+    p->blocked = req;
+    int received = p->recv_count;
+    metadata md;
+    md.tag = req->tag;
+    md.count = req->count;
+    sem_post(&p->mutex);
+
+    send_control(req->peer, TAG_WAITING, received, &md);
+}
+
+// Pushes the send's frames out from the calling thread until it completes.
+static void drive_send(request* req) {
+    peer* p = &rec_data.peers[req->peer];
+    while (!is_done(req)) {
+        ASSERT_SYS_OK(sem_wait(&p->send_mutex));
+        outbox_progress(req->peer);
+        bool stalled = p->out_stalled;
+        bool queued = req->queued;
+        ASSERT_SYS_OK(sem_post(&p->send_mutex));
+        if (is_done(req) || !queued) {
+            // rendezvous sends then wait for the receiver's progress thread
+            break;
+        }
+        outbox_sleep(req->peer, stalled, -1);
+    }
+}
+
+// Writes whatever is left in outboxes before the channels get closed.
+static void flush_outboxes() {
+    for (int i = 0; i < world_size; i++) {
+        if (i == rank) {
+            continue;
+        }
+        peer* p = &rec_data.peers[i];
+        while (true) {
+            ASSERT_SYS_OK(sem_wait(&p->send_mutex));
+            outbox_progress(i);
+            bool empty = p->out_head == NULL;
+            bool stalled = p->out_stalled;
+            if (empty) {
+                p->sender_running = false;
+            }
+            ASSERT_SYS_OK(sem_post(&p->send_mutex));
+            if (empty) {
+                break;
+            }
+            outbox_sleep(i, stalled, FLUSH_TIMEOUT_MS);
+        }
+    }
+}
+
+
+// Reduction kernels combine res[i] = op(res[i], data[i]) over n elements.
+// Every (type, op) pair has its own loop over GCC vectors, built once for
+// 16-byte (SSE2) and once for 32-byte (AVX2) registers; the tail and
+// buffers at any alignment are handled by the unaligned types below.
+typedef void (*reduce_kernel)(void* res, const void* data, size_t n);
+
+#define DATATYPES 5
+#define OPS 4
+
+static const size_t datatype_size[DATATYPES] = {
+    [MIMPI_UINT8] = sizeof(uint8_t),
+    [MIMPI_INT32] = sizeof(int32_t),
+    [MIMPI_INT64] = sizeof(int64_t),
+    [MIMPI_FLOAT] = sizeof(float),
+    [MIMPI_DOUBLE] = sizeof(double),
+};
+
+static reduce_kernel reduce_kernels[DATATYPES][OPS];
+
+// Returns the size in bytes of count elements of the type, or -1 if
+// the type, the operation or the count is invalid or the size is not an int.
+static int typed_bytes(int count, MIMPI_Datatype datatype, MIMPI_Op op) {
+    if (count < 0 || (unsigned)datatype >= DATATYPES || (unsigned)op >= OPS) {
+        return -1;
+    }
+    size_t bytes = (size_t)count * datatype_size[datatype];
+    return bytes > INT_MAX ? -1 : (int)bytes;
+}
+
+#define DEFINE_VECTORS(W)                                                            \
+    typedef uint8_t v##W##_uint8 __attribute__((vector_size(W), aligned(1)));        \
+    typedef int8_t v##W##_int8 __attribute__((vector_size(W), aligned(1)));          \
+    typedef int32_t v##W##_int32 __attribute__((vector_size(W), aligned(1)));        \
+    typedef int64_t v##W##_int64 __attribute__((vector_size(W), aligned(1)));        \
+    typedef float v##W##_float __attribute__((vector_size(W), aligned(1)));          \
+    typedef double v##W##_double __attribute__((vector_size(W), aligned(1)));
+
+DEFINE_VECTORS(16)
+DEFINE_VECTORS(32)
+
+// VI is the integer vector of the same layout, used to blend by a mask.
+#define VEC_MAX(VT, VI, x, y) ((VT)(((VI)((x) > (y)) & (VI)(x)) | (~(VI)((x) > (y)) & (VI)(y))))
+#define VEC_MIN(VT, VI, x, y) ((VT)(((VI)((x) < (y)) & (VI)(x)) | (~(VI)((x) < (y)) & (VI)(y))))
+#define VEC_SUM(VT, VI, x, y) ((x) + (y))
+#define VEC_PROD(VT, VI, x, y) ((x) * (y))
+#define SCALAR_MAX(x, y) ((x) > (y) ? (x) : (y))
+#define SCALAR_MIN(x, y) ((x) < (y) ? (x) : (y))
+#define SCALAR_SUM(x, y) ((x) + (y))
+#define SCALAR_PROD(x, y) ((x) * (y))
+
+#define DEFINE_KERNEL(ATTR, W, T, CT, VT, VI, OP)                                    \
+    ATTR static void reduce_##W##_##T##_##OP(void* res, const void* data, size_t n) { \
+        char* r = res;                                                               \
+        const char* a = data;                                                        \
+        size_t bytes = n * sizeof(CT);                                               \
+        size_t i = 0;                                                                \
+        for (; i + W <= bytes; i += W) {                                             \
+            VT x = *(VT*)(r + i);                                                    \
+            VT y = *(const VT*)(a + i);                                              \
+            *(VT*)(r + i) = VEC_##OP(VT, VI, x, y);                                  \
+        }                                                                            \
+        for (; i < bytes; i += sizeof(CT)) {                                         \
+            CT x, y;                                                                 \
+            memcpy(&x, r + i, sizeof(x));                                            \
+            memcpy(&y, a + i, sizeof(y));                                            \
+            x = SCALAR_##OP(x, y);                                                   \
+            memcpy(r + i, &x, sizeof(x));                                            \
+        }                                                                            \
+    }
+
+#define DEFINE_TYPE_KERNELS(ATTR, W, T, CT, VI)                                      \
+    DEFINE_KERNEL(ATTR, W, T, CT, v##W##_##T, VI, MAX)                               \
+    DEFINE_KERNEL(ATTR, W, T, CT, v##W##_##T, VI, MIN)                               \
+    DEFINE_KERNEL(ATTR, W, T, CT, v##W##_##T, VI, SUM)                               \
+    DEFINE_KERNEL(ATTR, W, T, CT, v##W##_##T, VI, PROD)
+
+#define DEFINE_KERNELS(ATTR, W)                                                      \
+    DEFINE_TYPE_KERNELS(ATTR, W, uint8, uint8_t, v##W##_int8)                        \
+    DEFINE_TYPE_KERNELS(ATTR, W, int32, int32_t, v##W##_int32)                       \
+    DEFINE_TYPE_KERNELS(ATTR, W, int64, int64_t, v##W##_int64)                       \
+    DEFINE_TYPE_KERNELS(ATTR, W, float, float, v##W##_int32)                         \
+    DEFINE_TYPE_KERNELS(ATTR, W, double, double, v##W##_int64)
+
+DEFINE_KERNELS(, 16)
+#if defined(__x86_64__) || defined(__i386__)
+DEFINE_KERNELS(__attribute__((target("avx2"))), 32)
+#endif
+
+#define KERNEL_ROW(W, T) { [MIMPI_MAX] = reduce_##W##_##T##_MAX, [MIMPI_MIN] = reduce_##W##_##T##_MIN, \
+                           [MIMPI_SUM] = reduce_##W##_##T##_SUM, [MIMPI_PROD] = reduce_##W##_##T##_PROD }
+
+static void select_kernels() {
+    static const reduce_kernel sse2[DATATYPES][OPS] = {
+        [MIMPI_UINT8] = KERNEL_ROW(16, uint8),
+        [MIMPI_INT32] = KERNEL_ROW(16, int32),
+        [MIMPI_INT64] = KERNEL_ROW(16, int64),
+        [MIMPI_FLOAT] = KERNEL_ROW(16, float),
+        [MIMPI_DOUBLE] = KERNEL_ROW(16, double),
+    };
+    memcpy(reduce_kernels, sse2, sizeof(sse2));
+#if defined(__x86_64__) || defined(__i386__)
+    static const reduce_kernel avx2[DATATYPES][OPS] = {
+        [MIMPI_UINT8] = KERNEL_ROW(32, uint8),
+        [MIMPI_INT32] = KERNEL_ROW(32, int32),
+        [MIMPI_INT64] = KERNEL_ROW(32, int64),
+        [MIMPI_FLOAT] = KERNEL_ROW(32, float),
+        [MIMPI_DOUBLE] = KERNEL_ROW(32, double),
+    };
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        memcpy(reduce_kernels, avx2, sizeof(avx2));
+    }
+#endif
+}
+
+// Orientation of the group tree for a collective rooted at given rank.
+// Group channels link every process with its neighbours in a binary heap
+// both ways, so the heap can hang from any process: links on the path
+// from the root to heap position 1 just point the other way.
+struct gr_tree {
+    int parent_in;
+    int parent_out;
+    int children;
+    int child_rank[3];
+    int child_in[3];
+    int child_out[3];
+};
+typedef struct gr_tree gr_tree;
+
+// Heap position of the neighbour of pos on the way to root_pos,
+// 0 at the root itself.
+static int gr_toward(int pos, int root_pos) {
+    if (pos == root_pos) {
+        return 0;
+    }
+    int toward = pos / 2;
+    for (int p = root_pos; p > pos; p /= 2) {
+        if (p / 2 == pos) {
+            toward = p;
+        }
+    }
+    return toward;
+}
+
+static void gr_tree_at(int root_rank, gr_tree* t) {
+    int pos = rank + 1;
+    int toward = gr_toward(pos, root_rank + 1);
+
+    int neighbours[3] = {pos / 2, pos * 2, pos * 2 + 1};
+    int in[3] = {GR_ROOT_IN, GR_LEFT_IN, GR_RIGHT_IN};
+    int out[3] = {GR_ROOT_OUT, GR_LEFT_OUT, GR_RIGHT_OUT};
+    t->parent_in = -1;
+    t->parent_out = -1;
+    t->children = 0;
+    for (int i = 0; i < 3; i++) {
+        if (neighbours[i] < 1 || neighbours[i] > world_size) {
+            continue;
+        }
+        if (neighbours[i] == toward) {
+            t->parent_in = in[i];
+            t->parent_out = out[i];
+        }
+        else {
+            t->child_rank[t->children] = neighbours[i] - 1;
+            t->child_in[t->children] = in[i];
+            t->child_out[t->children] = out[i];
+            t->children++;
+        }
+    }
+}
+
+static void gr_close(gr_tree* t) {
+    gr_comm = false;
+    if (t->parent_in != -1) {
+        ASSERT_SYS_OK(close(t->parent_in));
+        ASSERT_SYS_OK(close(t->parent_out));
+    }
+    for (int i = 0; i < t->children; i++) {
+        ASSERT_SYS_OK(close(t->child_in[i]));
+        ASSERT_SYS_OK(close(t->child_out[i]));
+    }
+}
+
+// Passes the news of a finished process on to all neighbours.
+static void gr_abort(gr_tree* t) {
+    char comm = GR_FINALIZE;
+    if (t->parent_out != -1) {
+        trysend(t->parent_out, &comm, sizeof(char));
+    }
+    for (int i = 0; i < t->children; i++) {
+        trysend(t->child_out[i], &comm, sizeof(char));
+    }
+    gr_close(t);
+}
+
+static void gr_send_down(gr_tree* t, const void* buf, size_t size) {
+    for (int i = 0; i < t->children; i++) {
+        trysend(t->child_out[i], buf, size);
+    }
+}
+
+// Collects statuses of children and reports readiness to the parent.
+// Returns false, without reporting, if a child reported a finished process.
+static bool gr_status_up(gr_tree* t) {
+    bool finished = false;
+    for (int i = 0; i < t->children; i++) {
+        char comm = GR_READY;
+        tryrecv(t->child_in[i], &comm, sizeof(char));
+        finished |= comm == GR_FINALIZE;
+    }
+    if (finished) {
+        return false;
+    }
+    if (t->parent_in != -1) {
+        char mycomm = GR_READY;
+        trysend(t->parent_out, &mycomm, sizeof(char));
+    }
+    return true;
+}
+
+// Passes the status from the root down the tree and returns it.
+static char gr_status_down(gr_tree* t) {
+    char mycomm = GR_READY;
+    if (t->parent_in != -1) {
+        tryrecv(t->parent_in, &mycomm, sizeof(char));
+    }
+    gr_send_down(t, &mycomm, sizeof(char));
+    return mycomm;
+}
+
+static void coll_enqueue(coll_op* op) {
+    op->next = NULL;
+    ASSERT_SYS_OK(sem_wait(&coll_queue_mutex));
+    if (coll_queue_tail == NULL) {
+        coll_queue_head = op;
+    }
+    else {
+        coll_queue_tail->next = op;
+    }
+    coll_queue_tail = op;
+    ASSERT_SYS_OK(sem_post(&coll_queue_mutex));
+    ASSERT_SYS_OK(sem_post(&coll_queue_ready));
+}
+
+// Waits for non-blocking collectives called so far, so that a blocking
+// one never uses channels together with the collective thread.
+static void coll_sync() {
+    batch_flush_all();
+    if (!coll_thread_running) {
+        return;
+    }
+    coll_op* op = (coll_op*) malloc(sizeof(coll_op));
+    assert(op != NULL);
+    op->kind = OP_SYNC;
+    op->req = new_request(REQ_COLL, -1, TAG_COLL, 0, NULL);
+    request* req = op->req;
+    coll_enqueue(op);
+    ASSERT_SYS_OK(sem_wait(&req->done_sem));
+    finish_request(req);
+}
+
+// Stops the collective thread once it is done with all queued operations.
+static void coll_thread_stop() {
+    if (!coll_thread_running) {
+        return;
+    }
+    coll_op* op = (coll_op*) malloc(sizeof(coll_op));
+    assert(op != NULL);
+    op->kind = OP_STOP;
+    op->req = NULL;
+    coll_enqueue(op);
+    ASSERT_ZERO(pthread_join(coll_thread, NULL));
+    ASSERT_SYS_OK(sem_destroy(&coll_queue_mutex));
+    ASSERT_SYS_OK(sem_destroy(&coll_queue_ready));
+    coll_thread_running = false;
+}
+
+// Lets every process know that collectives of this one are over, for those
+// waiting for it in a collective over p-p channels. Returns the error the
+// collective has to report.
+static MIMPI_Retcode coll_notify_abort() {
+    for (int i = 0; i < world_size; i++) {
+        if (i != rank) {
+            send_control(i, TAG_COLL_ABORT, 0, NULL);
+        }
+    }
+    return MIMPI_ERROR_REMOTE_FINISHED;
+}
+
+// Breaks collectives of the process after a failure over p-p channels.
+static MIMPI_Retcode coll_fail() {
+    if (gr_comm) {
+        gr_tree t;
+        gr_tree_at(0, &t);
+        gr_abort(&t);
+    }
+    return coll_notify_abort();
+}
+
+static int coll_next_tag() {
+    return TAG_COLL - coll_seq++ % COLL_TAGS;
+}
+
+static request* coll_isend(const void* data, int count, int dest, int tag) {
+    request* req = new_request(REQ_SEND, dest, tag, count, (void*) data);
+    outbox_push(dest, req);
+    return req;
+}
+
+static request* coll_irecv(void* data, int count, int source, int tag) {
+    request* req = new_request(REQ_RECV, source, tag, count, data);
+    post_recv(req);
+    return req;
+}
+
+// Waits for a request of a collective. The first failure breaks collectives
+// of the process at once, so nobody keeps waiting for it, and every other
+// pending request of the collective completes, one way or the other.
+static void coll_wait(request* req, MIMPI_Retcode* res) {
+    if (MIMPI_Wait(&req) != MIMPI_SUCCESS && *res == MIMPI_SUCCESS) {
+        *res = coll_fail();
+    }
+}
+
+// Tree of a collective over p-p channels, with ranks of neighbours.
+// Children are listed starting from the one with the largest subtree.
+struct coll_tree {
+    int parent;
+    int children;
+    int* child;
+};
+typedef struct coll_tree coll_tree;
+
+// Builds the neighbourhood of a process in the tree of given algorithm,
+// in ranks relative to the root. The ring is a chain, each process but
+// the last has one child.
+static void coll_tree_of(int alg, int size, int root_rank, int of_rank, coll_tree* t) {
+    int vrank = (of_rank - root_rank + size) % size;
+    t->parent = -1;
+    t->children = 0;
+    t->child = (int*) malloc(size * sizeof(int));
+    assert(t->child != NULL);
+    if (alg == ALG_BINOMIAL) {
+        int mask = 1;
+        while (mask < size && (vrank & mask) == 0) {
+            mask <<= 1;
+        }
+        if (vrank > 0) {
+            t->parent = vrank - mask;
+        }
+        for (mask >>= 1; mask > 0; mask >>= 1) {
+            if (vrank + mask < size) {
+                t->child[t->children++] = vrank + mask;
+            }
+        }
+    }
+    else {
+        int k = alg == ALG_RING ? 1 : coll_kary;
+        if (vrank > 0) {
+            t->parent = (vrank - 1) / k;
+        }
+        for (int i = 1; i <= k && vrank * k + i < size; i++) {
+            t->child[t->children++] = vrank * k + i;
+        }
+    }
+
+    if (t->parent != -1) {
+        t->parent = (t->parent + root_rank) % size;
+    }
+    for (int i = 0; i < t->children; i++) {
+        t->child[i] = (t->child[i] + root_rank) % size;
+    }
+}
+
+static void coll_tree_at(int alg, int root_rank, coll_tree* t) {
+    coll_tree_of(alg, world_size, root_rank, rank, t);
+}
+
+// Tree of a communicator, the root given by its rank there. Neighbours
+// are given by world ranks, as p-p channels need them.
+static void coll_tree_in(communicator* comm, int alg, int root_rank, coll_tree* t) {
+    if (comm == NULL) {
+        coll_tree_at(alg, root_rank, t);
+        return;
+    }
+    coll_tree_of(alg, comm->size, root_rank, comm->rank, t);
+    if (t->parent != -1) {
+        t->parent = comm->ranks[t->parent];
+    }
+    for (int i = 0; i < t->children; i++) {
+        t->child[i] = comm->ranks[t->child[i]];
+    }
+}
+
+static int coll_tag_in(communicator* comm) {
+    if (comm == NULL) {
+        return coll_next_tag();
+    }
+    return comm->tag_base - comm->seq++ % COMM_TAGS;
+}
+
+// Empty messages go from every process to its parent, once it got them
+// from all its children.
+static MIMPI_Retcode coll_tree_up(coll_tree* t, int tag) {
+    MIMPI_Retcode res = MIMPI_SUCCESS;
+    request** reqs = (request**) malloc((t->children + 1) * sizeof(request*));
+    assert(reqs != NULL);
+    for (int i = 0; i < t->children; i++) {
+        reqs[i] = coll_irecv(NULL, 0, t->child[i], tag);
+    }
+    for (int i = 0; i < t->children; i++) {
+        coll_wait(reqs[i], &res);
+    }
+    if (res == MIMPI_SUCCESS && t->parent != -1) {
+        coll_wait(coll_isend(NULL, 0, t->parent, tag), &res);
+    }
+    free(reqs);
+    return res;
+}
+
+// Empty messages go from the root to the leaves.
+static MIMPI_Retcode coll_tree_down(coll_tree* t, int tag) {
+    MIMPI_Retcode res = MIMPI_SUCCESS;
+    if (t->parent != -1) {
+        coll_wait(coll_irecv(NULL, 0, t->parent, tag), &res);
+    }
+    if (res != MIMPI_SUCCESS) {
+        return res;
+    }
+    request** reqs = (request**) malloc((t->children + 1) * sizeof(request*));
+    assert(reqs != NULL);
+    for (int i = 0; i < t->children; i++) {
+        reqs[i] = coll_isend(NULL, 0, t->child[i], tag);
+    }
+    for (int i = 0; i < t->children; i++) {
+        coll_wait(reqs[i], &res);
+    }
+    free(reqs);
+    return res;
+}
+
+// Algorithm of the collective for a payload of given size. Every process
+// makes the same choice, as it depends only on arguments every process
+// passes the same. The heap tree moves small payloads in the fewest
+// messages. In the pipelined ring every process sends the payload only
+// once instead of twice, which pays off for large payloads only when
+// processes really run in parallel. Gather and scatter move every block
+// only towards or from the root, so they stay on the heap.
+static int coll_choose(int collective, size_t bytes) {
+    if (coll_alg[collective] != ALG_AUTO) {
+        return coll_alg[collective];
+    }
+    bool ring_fits = collective != COLL_BARRIER && collective != COLL_GATHER && collective != COLL_SCATTER;
+    if (ring_fits && bytes >= COLL_RING_MIN && world_size > 2 && coll_cpus >= world_size) {
+        return ALG_RING;
+    }
+    return ALG_HEAP;
+}
+
+// MIMPI_COLL_ALG holds comma separated entries, either an algorithm
+// for all collectives or collective=algorithm. The dissemination barrier
+// exists only for the barrier.
+static void coll_init() {
+    static const char* const alg_names[ALGORITHMS] = {
+        [ALG_AUTO] = "auto", [ALG_HEAP] = "heap", [ALG_BINOMIAL] = "binomial",
+        [ALG_KARY] = "kary", [ALG_RING] = "ring", [ALG_DISSEMINATION] = "dissemination",
+    };
+    static const char* const coll_names[COLLECTIVES] = {
+        [COLL_BARRIER] = "barrier", [COLL_BCAST] = "bcast", [COLL_REDUCE] = "reduce",
+        [COLL_ALLREDUCE] = "allreduce", [COLL_GATHER] = "gather", [COLL_SCATTER] = "scatter",
+        [COLL_ALLGATHER] = "allgather",
+    };
+    coll_seq = 0;
+    comm_splits = 0;
+    coll_thread_running = false;
+    coll_queue_head = NULL;
+    coll_queue_tail = NULL;
+    coll_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 0; i < COLLECTIVES; i++) {
+        coll_alg[i] = ALG_AUTO;
+    }
+    const char* kary_str = getenv(COLL_KARY_VAR);
+    coll_kary = kary_str != NULL && atoi(kary_str) > 0 ? atoi(kary_str) : COLL_KARY_DEFAULT;
+
+    const char* alg_str = getenv(COLL_ALG_VAR);
+    if (alg_str == NULL) {
+        return;
+    }
+    char* spec = strdup(alg_str);
+    assert(spec != NULL);
+    char* save;
+    for (char* entry = strtok_r(spec, ",", &save); entry != NULL; entry = strtok_r(NULL, ",", &save)) {
+        char* name = strchr(entry, '=');
+        int first = 0, last = COLLECTIVES - 1;
+        if (name != NULL) {
+            *name++ = '\0';
+            for (first = 0; first < COLLECTIVES && strcmp(entry, coll_names[first]) != 0; first++) {}
+            last = first;
+        }
+        else {
+            name = entry;
+        }
+        int alg = 0;
+        while (alg < ALGORITHMS && strcmp(name, alg_names[alg]) != 0) {
+            alg++;
+        }
+        if (alg == ALGORITHMS || first == COLLECTIVES) {
+            fprintf(stderr, "MIMPI: ignoring an invalid entry of %s\n", COLL_ALG_VAR);
+            continue;
+        }
+        for (int i = first; i <= last; i++) {
+            if (alg != ALG_DISSEMINATION || i == COLL_BARRIER) {
+                coll_alg[i] = alg;
+            }
+        }
+    }
+    free(spec);
+}
+
+void MIMPI_Init(bool enable_deadlock_detection) {
+    deadlock = enable_deadlock_detection;
+    channels_init();
+    rank = atoi(getenv("MIMPI_RANK"));
+    world_size = atoi(getenv("MIMPI_WORLD_SIZE"));
+    unsetenv("MIMPI_WORLD_SIZE");
+    unsetenv("MIMPI_RANK");
+
+    pool_init();
+    shm_init();
+    select_kernels();
+    coll_init();
+    const char* threshold_str = getenv(RENDEZVOUS_VAR);
+    rendezvous_threshold = threshold_str == NULL ? 0 : atoi(threshold_str);
+    // a send waiting for TAG_CTS would block unseen by deadlock detection
+    if (deadlock) {
+        rendezvous_threshold = 0;
+    }
+    const char* batch_str = getenv(BATCH_VAR);
+    batch_limit = batch_str == NULL || atoi(batch_str) <= 0 ? 0 : atoi(batch_str);
+    rec_data.peers = (peer*) malloc(world_size * sizeof(peer));
+    assert(rec_data.peers != NULL);
+    for (int i = 0; i < world_size; i++) {
+        peer* p = &rec_data.peers[i];
+        ASSERT_SYS_OK(sem_init(&p->mutex, 0, 1));
+        index_init(&p->queue);
+        p->posted_head = NULL;
+        p->posted_tail = NULL;
+        p->blocked = NULL;
+        p->receiver_running = true;
+        p->coll_aborted = false;
+        p->other_waiting.tag = -1;
+        p->other_waiting.count = -1;
+        p->sent_queue = NULL;
+        p->sent_count = 0;
+        p->recv_count = 0;
+        ASSERT_SYS_OK(sem_init(&p->send_mutex, 0, 1));
+        p->out_head = NULL;
+        p->out_tail = NULL;
+        p->out_sent = 0;
+        p->out_polled = false;
+        p->sender_running = true;
+        p->out_token.count = 0;
+        p->out_stalled = false;
+        p->engine = NULL;
+        p->rdv_sends = NULL;
+        p->rts_sent = 0;
+        p->batch = NULL;
+        p->batch_size = 0;
+        p->rdv_recvs = NULL;
+        p->rts_received = 0;
+    }
+
+    arrival_seq = 0;
+    post_seq = 0;
+    ASSERT_SYS_OK(sem_init(&any_mutex, 0, 1));
+    any_head = NULL;
+    any_tail = NULL;
+    any_posted = 0;
+    open_sources = world_size - 1;
+
+    gr_comm = true;
+
+    start_engines();
+}
+
+void MIMPI_Finalize() {
+    coll_thread_stop();
+    batch_flush_all();
+    flush_outboxes();
+    // close sending channels
+    for (int i = 0; i < world_size; i++) {
+        if (i != rank) {
+            ASSERT_SYS_OK(close(ppfdout(i)));
+        }
+    }
+    // WYSLAC INNYM PROCESOM W GRUPOWEJ ZE SKONCZYLEM DZIALAC
+
+
+    if (gr_comm) {
+        gr_tree t;
+        gr_tree_at(0, &t);
+        gr_abort(&t);
+    }
+
+
+    // wait for all threads, then free memory, semaphores
+    stop_engines();
+
+//     free all memory
+    for (int i = 0; i < world_size; i++) {
+        peer* p = &rec_data.peers[i];
+        index_free(&p->queue);
+        sent_q * list = p->sent_queue;
+        while (list != NULL) {
+            sent_q* temp = list;
+            list = list->next;
+            pool_free(temp, sizeof(sent_q));
+        }
+        ASSERT_SYS_OK(sem_destroy(&p->mutex));
+        ASSERT_SYS_OK(sem_destroy(&p->send_mutex));
+    }
+    free(rec_data.peers);
+    ASSERT_SYS_OK(sem_destroy(&any_mutex));
+    pool_destroy();
+    shm_destroy();
+
+
+//    print_open_descriptors();
+
+    channels_finalize();
+}
+
+int MIMPI_World_size() {
+    return world_size;
+}
+
+int MIMPI_World_rank() {
+    return rank;
+}
+
+// Sends the message of a send request with checked destination. Returns
+// an error, leaving the request alone, if the send could not even start.
+static MIMPI_Retcode start_send(request* req) {
+    int destination = req->peer;
+    metadata md;
+    md.count = req->count;
+    md.tag = req->tag;
+
+    if (deadlock) {
+        peer* p = &rec_data.peers[destination];
+        ASSERT_SYS_OK(sem_wait(&p->mutex));
+        if (!p->receiver_running) {
+            ASSERT_SYS_OK(sem_post(&p->mutex));
+            return MIMPI_ERROR_REMOTE_FINISHED;
+        }
+
+        if (tag_matches(p->other_waiting.tag, md.tag) && p->other_waiting.count == md.count) {
+            p->other_waiting.tag = -1;
+            p->other_waiting.count = -1;
+        }
+        add_sent_queue(destination, md);
+        ASSERT_SYS_OK(sem_post(&p->mutex));
+    }
+
+    if (rendezvous_threshold > 0 && req->count >= rendezvous_threshold) {
+        peer* p = &rec_data.peers[destination];
+        ASSERT_SYS_OK(sem_wait(&p->send_mutex));
+        req->kind = REQ_RTS;
+        req->rts_id = p->rts_sent++;
+        req->frame[0].tag = TAG_RTS;
+        req->frame[1].count = req->rts_id;
+        req->frame[1].tag = md.tag;
+        req->frame_size = 2 * sizeof(metadata);
+        outbox_append(destination, req);
+        ASSERT_SYS_OK(sem_post(&p->send_mutex));
+    }
+    else if (batched(req->count)) {
+        batch_append(destination, req);
+    }
+    else {
+        outbox_push(destination, req);
+    }
+    return MIMPI_SUCCESS;
+}
+
+MIMPI_Retcode MIMPI_Isend(
+        void const *data,
+        int count,
+        int destination,
+        int tag,
+        MIMPI_Request *request
+) {
+    *request = MIMPI_REQUEST_NULL;
+    if (destination == rank) {
+        return MIMPI_ERROR_ATTEMPTED_SELF_OP;
+    }
+
+    if (destination < 0 || destination >= world_size) {
+        return MIMPI_ERROR_NO_SUCH_RANK;
+    }
+
+    struct MIMPI_Request_s* req = new_request(REQ_SEND, destination, tag, count, (void*) data);
+    MIMPI_Retcode res = start_send(req);
+    if (res != MIMPI_SUCCESS) {
+        finish_request(req);
+        return res;
+    }
+    *request = req;
+    return MIMPI_SUCCESS;
+}
+
+MIMPI_Retcode MIMPI_Irecv(
+        void *data,
+        int count,
+        int source,
+        int tag,
+        MIMPI_Request *request
+) {
+    *request = MIMPI_REQUEST_NULL;
+    if (source == rank) {
+        return MIMPI_ERROR_ATTEMPTED_SELF_OP;
+    }
+
+    if ((source < 0 && source != MIMPI_ANY_SOURCE) || source >= world_size) {
+        return MIMPI_ERROR_NO_SUCH_RANK;
+    }
+
+    struct MIMPI_Request_s* req = new_request(REQ_RECV, source, tag, count, data);
+    post_recv(req);
+    *request = req;
+    return MIMPI_SUCCESS;
+}
+
+MIMPI_Retcode MIMPI_Wait(MIMPI_Request *request) {
+    struct MIMPI_Request_s* req = *request;
+    if (req == MIMPI_REQUEST_NULL || !req->active) {
+        return MIMPI_SUCCESS;
+    }
+
+    if (!is_done(req)) {
+        batch_flush_all();
+    }
+    if (req->kind == REQ_SEND) {
+        drive_send(req);
+    }
+    else if (deadlock && req->kind == REQ_RECV && !req->any_source && req->tag >= MIMPI_ANY_TAG) {
+        block_on_recv(req);
+    }
+    ASSERT_SYS_OK(sem_wait(&req->done_sem));
+    if (req->persistent) {
+        req->active = false;
+        return req->result;
+    }
+    *request = MIMPI_REQUEST_NULL;
+    return finish_request(req);
+}
+
+MIMPI_Retcode MIMPI_Waitall(int count, MIMPI_Request requests[]) {
+    MIMPI_Retcode result = MIMPI_SUCCESS;
+    for (int i = 0; i < count; i++) {
+        MIMPI_Retcode res = MIMPI_Wait(&requests[i]);
+        if (result == MIMPI_SUCCESS) {
+            result = res;
+        }
+    }
+    return result;
+}
+
+MIMPI_Retcode MIMPI_Test(MIMPI_Request *request, bool *flag) {
+    if (*request == MIMPI_REQUEST_NULL || !(*request)->active) {
+        *flag = true;
+        return MIMPI_SUCCESS;
+    }
+
+    struct MIMPI_Request_s* req = *request;
+    if (!is_done(req)) {
+        batch_flush_all();
+    }
+    if (req->kind == REQ_SEND && !is_done(req)) {
+        peer* p = &rec_data.peers[req->peer];
+        ASSERT_SYS_OK(sem_wait(&p->send_mutex));
+        outbox_progress(req->peer);
+        ASSERT_SYS_OK(sem_post(&p->send_mutex));
+    }
+    *flag = is_done(req);
+    if (!*flag) {
+        return MIMPI_SUCCESS;
+    }
+    return MIMPI_Wait(request);
+}
+
+MIMPI_Retcode MIMPI_Testany(int count, MIMPI_Request requests[], int *index, bool *flag) {
+    bool active = false;
+    *index = -1;
+    for (int i = 0; i < count; i++) {
+        if (requests[i] == MIMPI_REQUEST_NULL || !requests[i]->active) {
+            continue;
+        }
+        active = true;
+        MIMPI_Retcode res = MIMPI_Test(&requests[i], flag);
+        if (*flag) {
+            *index = i;
+            return res;
+        }
+    }
+    *flag = !active;
+    return MIMPI_SUCCESS;
+}
+
+MIMPI_Retcode MIMPI_Send_init(
+        void const *data,
+        int count,
+        int destination,
+        int tag,
+        MIMPI_Request *request
+) {
+    *request = MIMPI_REQUEST_NULL;
+    if (destination == rank) {
+        return MIMPI_ERROR_ATTEMPTED_SELF_OP;
     }
 
     if (destination < 0 || destination >= world_size) {
         return MIMPI_ERROR_NO_SUCH_RANK;
     }
 
-    metadata md;
-    md.count = count;
-    md.tag = tag;
-    
-    if (deadlock) {
-        ASSERT_SYS_OK(sem_wait(&rec_data.mutex));
-        if (!rec_data.receiver_running[destination]) {
-            ASSERT_SYS_OK(sem_post(&rec_data.mutex));
-            return MIMPI_ERROR_REMOTE_FINISHED;
-        }
-        ASSERT_SYS_OK(sem_post(&rec_data.mutex));
+    struct MIMPI_Request_s* req = new_request(REQ_SEND, destination, tag, count, (void*) data);
+    req->persistent = true;
+    req->active = false;
+    *request = req;
+    return MIMPI_SUCCESS;
+}
+
+MIMPI_Retcode MIMPI_Recv_init(
+        void *data,
+        int count,
+        int source,
+        int tag,
+        MIMPI_Request *request
+) {
+    *request = MIMPI_REQUEST_NULL;
+    if (source == rank) {
+        return MIMPI_ERROR_ATTEMPTED_SELF_OP;
+    }
+
+    if ((source < 0 && source != MIMPI_ANY_SOURCE) || source >= world_size) {
+        return MIMPI_ERROR_NO_SUCH_RANK;
+    }
+
+    struct MIMPI_Request_s* req = new_request(REQ_RECV, source, tag, count, data);
+    req->persistent = true;
+    req->active = false;
+    *request = req;
+    return MIMPI_SUCCESS;
+}
+
+// Arguments were checked by the init call, the request only gets reset.
+MIMPI_Retcode MIMPI_Start(MIMPI_Request *request) {
+    struct MIMPI_Request_s* req = *request;
+    if (req == MIMPI_REQUEST_NULL || !req->persistent || req->active) {
+        return MIMPI_ERROR_INVALID_ARGUMENT;
+    }
+    if (req->kind == REQ_RECV) {
+        restart_request(req, REQ_RECV);
+        post_recv(req);
+        return MIMPI_SUCCESS;
+    }
+    restart_request(req, REQ_SEND);
+    MIMPI_Retcode res = start_send(req);
+    if (res != MIMPI_SUCCESS) {
+        req->active = false;
+    }
+    return res;
+}
+
+MIMPI_Retcode MIMPI_Startall(int count, MIMPI_Request requests[]) {
+    MIMPI_Retcode result = MIMPI_SUCCESS;
+    for (int i = 0; i < count; i++) {
+        MIMPI_Retcode res = MIMPI_Start(&requests[i]);
+        if (result == MIMPI_SUCCESS) {
+            result = res;
+        }
+    }
+    return result;
+}
+
+void MIMPI_Request_free(MIMPI_Request *request) {
+    struct MIMPI_Request_s* req = *request;
+    if (req == MIMPI_REQUEST_NULL) {
+        return;
+    }
+    MIMPI_Wait(request);
+    if (req->persistent) {
+        finish_request(req);
+        *request = MIMPI_REQUEST_NULL;
+    }
+}
+
+MIMPI_Retcode MIMPI_Send(
+        void const *data,
+        int count,
+        int destination,
+        int tag
+) {
+    MIMPI_Request request;
+    MIMPI_Retcode res = MIMPI_Isend(data, count, destination, tag, &request);
+    if (res != MIMPI_SUCCESS) {
+        return res;
+    }
+    return MIMPI_Wait(&request);
+}
+
+
+MIMPI_Retcode MIMPI_Recv(
+        void *data,
+        int count,
+        int source,
+        int tag
+) {
+    MIMPI_Request request;
+    MIMPI_Retcode res = MIMPI_Irecv(data, count, source, tag, &request);
+    if (res != MIMPI_SUCCESS) {
+        return res;
+    }
+    return MIMPI_Wait(&request);
+}
+
+// The request is persistent, so that the source it matched can be read
+// after it completes.
+MIMPI_Retcode MIMPI_Recv_any(
+        void *data,
+        int count,
+        int tag,
+        int *source
+) {
+    MIMPI_Request request;
+    MIMPI_Retcode res = MIMPI_Recv_init(data, count, MIMPI_ANY_SOURCE, tag, &request);
+    if (res == MIMPI_SUCCESS) {
+        MIMPI_Start(&request);
+        res = MIMPI_Wait(&request);
+    }
+    if (source != NULL) {
+        *source = res == MIMPI_SUCCESS ? request->peer : MIMPI_ANY_SOURCE;
+    }
+    MIMPI_Request_free(&request);
+    return res;
+}
+
+// The send is started before the receive is waited for, so two processes
+// exchanging data this way never wait for each other.
+MIMPI_Retcode MIMPI_Sendrecv(
+        void const *send_data,
+        int send_count,
+        int destination,
+        int send_tag,
+        void *recv_data,
+        int recv_count,
+        int source,
+        int recv_tag
+) {
+    MIMPI_Request requests[2];
+    MIMPI_Retcode res = MIMPI_Isend(send_data, send_count, destination, send_tag, &requests[0]);
+    if (res != MIMPI_SUCCESS) {
+        return res;
+    }
+    res = MIMPI_Irecv(recv_data, recv_count, source, recv_tag, &requests[1]);
+    if (res != MIMPI_SUCCESS) {
+        MIMPI_Wait(&requests[0]);
+        return res;
+    }
+    return MIMPI_Waitall(2, requests);
+}
+
+// All sends are queued before any is waited for, so outboxes of all
+// destinations get written to in turn instead of one after another.
+MIMPI_Retcode MIMPI_Send_multi(
+        void const *data,
+        int count,
+        int const *destinations,
+        int destinations_count,
+        int tag
+) {
+    MIMPI_Retcode result = MIMPI_SUCCESS;
+    MIMPI_Request* requests = (MIMPI_Request*) malloc((destinations_count + 1) * sizeof(MIMPI_Request));
+    assert(requests != NULL);
+    for (int i = 0; i < destinations_count; i++) {
+        MIMPI_Retcode res = MIMPI_Isend(data, count, destinations[i], tag, &requests[i]);
+        if (result == MIMPI_SUCCESS) {
+            result = res;
+        }
+    }
+    MIMPI_Retcode res = MIMPI_Waitall(destinations_count, requests);
+    free(requests);
+    return result != MIMPI_SUCCESS ? result : res;
+}
+
+// In round r every process sends to the one 2^r ranks ahead of it and
+// receives from the one 2^r ranks behind, so after ceil(log2(n)) rounds
+// every process has heard from all others, through some chain of messages.
+static MIMPI_Retcode barrier_dissemination() {
+    MIMPI_Retcode res = MIMPI_SUCCESS;
+    int tag = coll_next_tag();
+    for (int dist = 1; dist < world_size && res == MIMPI_SUCCESS; dist <<= 1) {
+        request* send = coll_isend(NULL, 0, (rank + dist) % world_size, tag);
+        coll_wait(coll_irecv(NULL, 0, (rank - dist + world_size) % world_size, tag), &res);
+        coll_wait(send, &res);
+    }
+    return res;
+}
+
+static MIMPI_Retcode barrier_tree(communicator* comm, int alg) {
+    coll_tree t;
+    coll_tree_in(comm, alg, 0, &t);
+    int tag = coll_tag_in(comm);
+    MIMPI_Retcode res = coll_tree_up(&t, tag);
+    if (res == MIMPI_SUCCESS) {
+        res = coll_tree_down(&t, tag);
+    }
+    free(t.child);
+    return res;
+}
+
+static MIMPI_Retcode barrier() {
+    if (!gr_comm) {
+        return MIMPI_ERROR_REMOTE_FINISHED;
+    }
+    int alg = coll_choose(COLL_BARRIER, 0);
+    if (alg == ALG_DISSEMINATION) {
+        return barrier_dissemination();
+    }
+    if (alg != ALG_HEAP) {
+        return barrier_tree(NULL, alg);
+    }
+
+    gr_tree t;
+    gr_tree_at(0, &t);
+    if (!gr_status_up(&t)) {
+        gr_abort(&t);
+        return coll_notify_abort();
+    }
+    if (gr_status_down(&t) == GR_FINALIZE) {
+        gr_close(&t);
+        return coll_notify_abort();
+    }
+    return MIMPI_SUCCESS;
+}
+
+MIMPI_Retcode MIMPI_Barrier() {
+    coll_sync();
+    return barrier();
+}
+
+// The payload goes down the tree in segments. Receives of the next
+// COLL_WINDOW segments are posted ahead, so segments land right in the
+// buffer while earlier ones are being forwarded.
+static MIMPI_Retcode coll_send_down(coll_tree* t, void* data, int count, int tag) {
+    MIMPI_Retcode res = MIMPI_SUCCESS;
+    request** sends = (request**) malloc((t->children + 1) * sizeof(request*));
+    assert(sends != NULL);
+    request* window[COLL_WINDOW];
+    int segments = count == 0 ? 1 : (int)(((size_t)count + GR_SEGMENT - 1) / GR_SEGMENT);
+    int posted = 0;
+    int sent = 0;
+
+    int seg = 0;
+    for (; seg < segments && res == MIMPI_SUCCESS; seg++) {
+        size_t off = (size_t)seg * GR_SEGMENT;
+        size_t segment = count - off < GR_SEGMENT ? count - off : GR_SEGMENT;
+        if (t->parent != -1) {
+            for (; posted < segments && posted < seg + COLL_WINDOW; posted++) {
+                size_t ahead = (size_t)posted * GR_SEGMENT;
+                size_t ahead_size = count - ahead < GR_SEGMENT ? count - ahead : GR_SEGMENT;
+                window[posted % COLL_WINDOW] = coll_irecv((char*)data + ahead, ahead_size, t->parent, tag);
+            }
+            coll_wait(window[seg % COLL_WINDOW], &res);
+        }
+        for (int i = 0; i < sent; i++) {
+            coll_wait(sends[i], &res);
+        }
+        sent = 0;
+        if (res != MIMPI_SUCCESS) {
+            break;
+        }
+        for (int i = 0; i < t->children; i++) {
+            sends[sent++] = coll_isend((char*)data + off, segment, t->child[i], tag);
+        }
+    }
+    for (int i = 0; i < sent; i++) {
+        coll_wait(sends[i], &res);
+    }
+    // after a failure receives posted ahead complete anyway
+    for (seg++; seg < posted; seg++) {
+        coll_wait(window[seg % COLL_WINDOW], &res);
+    }
+    free(sends);
+    return res;
+}
+
+// The payload only goes down once every process reported readiness up
+// the tree.
+static MIMPI_Retcode bcast_tree(communicator* comm, int alg, void* data, int count, int root_bcast) {
+    coll_tree t;
+    coll_tree_in(comm, alg, root_bcast, &t);
+    int tag = coll_tag_in(comm);
+    MIMPI_Retcode res = coll_tree_up(&t, tag);
+    if (res == MIMPI_SUCCESS) {
+        res = coll_send_down(&t, data, count, tag);
+    }
+    free(t.child);
+    return res;
+}
+
+// The status goes down together with the first segment, every further
+// segment is passed on to children as soon as it arrives from the parent.
+// Returns the status.
+static char gr_send_data_down(gr_tree* t, void* data, int count) {
+    char mycomm = GR_READY;
+    size_t first = count < GR_SEGMENT ? count : GR_SEGMENT;
+    char* stage = malloc(sizeof(char) + first);
+    assert(stage != NULL);
+    if (t->parent_in == -1) {
+        stage[0] = mycomm;
+        memcpy(stage + sizeof(char), data, first);
+    }
+    else {
+        tryrecv(t->parent_in, stage, sizeof(char) + first);
+        mycomm = stage[0];
+        if (mycomm != GR_FINALIZE) {
+            memcpy(data, stage + sizeof(char), first);
+        }
+    }
+    gr_send_down(t, stage, sizeof(char) + first);
+
+    for (size_t off = first; off < (size_t)count; off += GR_SEGMENT) {
+        size_t segment = count - off < GR_SEGMENT ? count - off : GR_SEGMENT;
+        // after a failure the payload is only passed on, not kept
+        char* buf = mycomm == GR_FINALIZE ? stage + sizeof(char) : (char*)data + off;
+        if (t->parent_in != -1) {
+            tryrecv(t->parent_in, buf, segment);
+        }
+        gr_send_down(t, buf, segment);
+    }
+    free(stage);
+    return mycomm;
+}
+
+static MIMPI_Retcode bcast(void* data, int count, int root_bcast) {
+    if (root_bcast < 0 || root_bcast >= world_size) {
+        return MIMPI_ERROR_NO_SUCH_RANK;
+    }
+    if (!gr_comm) {
+        return MIMPI_ERROR_REMOTE_FINISHED;
+    }
+    int alg = coll_choose(COLL_BCAST, count);
+    if (alg != ALG_HEAP) {
+        return bcast_tree(NULL, alg, data, count, root_bcast);
+    }
+
+    gr_tree t;
+    gr_tree_at(root_bcast, &t);
+    if (!gr_status_up(&t)) {
+        gr_abort(&t);
+        return coll_notify_abort();
+    }
+    if (gr_send_data_down(&t, data, count) == GR_FINALIZE) {
+        gr_close(&t);
+        return coll_notify_abort();
+    }
+    return MIMPI_SUCCESS;
+}
+
+MIMPI_Retcode MIMPI_Bcast(
+        void *data,
+        int count,
+        int root_bcast
+) {
+    coll_sync();
+    return bcast(data, count, root_bcast);
+}
+
+// res = own op others[0] op others[1] ...
+static void exec_MIMPI_Op(void* res, const void* own, char* const* others, int others_count,
+                          int count, MIMPI_Datatype datatype, MIMPI_Op op) {
+    reduce_kernel kernel = reduce_kernels[datatype][op];
+    memcpy(res, own, count * datatype_size[datatype]);
+    for (int i = 0; i < others_count; i++) {
+        kernel(res, others[i], count);
+    }
+}
+
+// Partial results go up in segments, every process reduces a segment
+// once all children delivered it, while its previous segment is still
+// on the way to the parent. The root reduces into recv_data.
+static MIMPI_Retcode coll_reduce_up(coll_tree* t, void const* send_data, void* recv_data, int bytes,
+                                    MIMPI_Datatype datatype, MIMPI_Op op, int tag) {
+    MIMPI_Retcode res = MIMPI_SUCCESS;
+    size_t first = bytes < GR_SEGMENT ? bytes : GR_SEGMENT;
+    size_t elem = datatype_size[datatype];
+    char** partial = (char**) malloc((t->children + 1) * sizeof(char*));
+    request** recvs = (request**) malloc((t->children + 1) * sizeof(request*));
+    assert(partial != NULL && recvs != NULL);
+    for (int i = 0; i < t->children; i++) {
+        partial[i] = malloc(first > 0 ? first : 1);
+        assert(partial[i] != NULL);
+    }
+    // non-root processes send from two buffers in turn
+    char* stage[2] = {NULL, NULL};
+    if (t->parent != -1) {
+        stage[0] = malloc(2 * (first > 0 ? first : 1));
+        assert(stage[0] != NULL);
+        stage[1] = stage[0] + (first > 0 ? first : 1);
+    }
+    request* send = NULL;
+
+    size_t off = 0;
+    for (int turn = 0; res == MIMPI_SUCCESS; turn ^= 1) {
+        size_t segment = bytes - off < GR_SEGMENT ? bytes - off : GR_SEGMENT;
+        for (int i = 0; i < t->children; i++) {
+            recvs[i] = coll_irecv(partial[i], segment, t->child[i], tag);
+        }
+        for (int i = 0; i < t->children; i++) {
+            coll_wait(recvs[i], &res);
+        }
+        if (res != MIMPI_SUCCESS) {
+            break;
+        }
+        char* out = stage[turn] != NULL ? stage[turn] : (char*)recv_data + off;
+        exec_MIMPI_Op(out, (const char*)send_data + off, partial, t->children, segment / elem, datatype, op);
+        if (send != NULL) {
+            coll_wait(send, &res);
+            send = NULL;
+        }
+        if (res == MIMPI_SUCCESS && t->parent != -1) {
+            send = coll_isend(out, segment, t->parent, tag);
+        }
+        off += segment;
+        if (off >= (size_t)bytes) {
+            break;
+        }
+    }
+    if (send != NULL) {
+        coll_wait(send, &res);
+    }
+    for (int i = 0; i < t->children; i++) {
+        free(partial[i]);
+    }
+    free(partial);
+    free(recvs);
+    free(stage[0]);
+    return res;
+}
+
+// Once the root has the result, it releases everybody down the tree,
+// so that nobody returns before all processes took part.
+static MIMPI_Retcode reduce_tree(communicator* comm, int alg, void const* send_data, void* recv_data,
+                                 int bytes, MIMPI_Datatype datatype, MIMPI_Op op, int root_reduce) {
+    coll_tree t;
+    coll_tree_in(comm, alg, root_reduce, &t);
+    int tag = coll_tag_in(comm);
+    MIMPI_Retcode res = coll_reduce_up(&t, send_data, recv_data, bytes, datatype, op, tag);
+    if (res == MIMPI_SUCCESS) {
+        res = coll_tree_down(&t, tag);
+    }
+    free(t.child);
+    return res;
+}
+
+// Partial results go up the tree segment by segment, every segment
+// is reduced as soon as all children delivered it. The status goes
+// up together with the first segment. The root reduces straight into
+// recv_data, others only keep the segment in flight. Returns false if
+// a child reported a finished process.
+static bool gr_reduce_up(gr_tree* t, void const* send_data, void* recv_data, int bytes,
+                         MIMPI_Datatype datatype, MIMPI_Op op) {
+    size_t first = bytes < GR_SEGMENT ? bytes : GR_SEGMENT;
+    char* comm[3];
+    char* partial[3];
+    bool finished = false;
+    for (int i = 0; i < t->children; i++) {
+        comm[i] = malloc(sizeof(char) + first);
+        assert(comm[i] != NULL);
+        tryrecv(t->child_in[i], comm[i], sizeof(char) + first);
+        finished |= comm[i][0] == GR_FINALIZE;
+        partial[i] = comm[i] + sizeof(char);
+    }
+    if (finished) {
+        for (int i = 0; i < t->children; i++) {
+            free(comm[i]);
+        }
+        return false;
+    }
+
+    size_t elem = datatype_size[datatype];
+    char* stage = NULL;
+    if (t->parent_in != -1) {
+        stage = malloc(sizeof(char) + first);
+        assert(stage != NULL);
+        stage[0] = GR_READY;
+    }
+
+    size_t off = 0;
+    do {
+        size_t segment = bytes - off < GR_SEGMENT ? bytes - off : GR_SEGMENT;
+        if (off > 0) {
+            for (int i = 0; i < t->children; i++) {
+                tryrecv(t->child_in[i], partial[i], segment);
+            }
+        }
+        char* out = stage != NULL ? stage + sizeof(char) : (char*)recv_data + off;
+        exec_MIMPI_Op(out, (const char*)send_data + off, partial, t->children, segment / elem, datatype, op);
+        if (stage != NULL) {
+            // the first segment carries the status
+            if (off == 0) {
+                trysend(t->parent_out, stage, sizeof(char) + segment);
+            }
+            else {
+                trysend(t->parent_out, out, segment);
+            }
+        }
+        off += segment;
+    } while (off < (size_t)bytes);
+    for (int i = 0; i < t->children; i++) {
+        free(comm[i]);
+    }
+    free(stage);
+    return true;
+}
+
+static MIMPI_Retcode reduce(void const* send_data, void* recv_data, int count,
+                            MIMPI_Datatype datatype, MIMPI_Op op, int root_reduce) {
+    if (root_reduce < 0 || root_reduce >= world_size) {
+        return MIMPI_ERROR_NO_SUCH_RANK;
+    }
+    int bytes = typed_bytes(count, datatype, op);
+    if (bytes < 0) {
+        return MIMPI_ERROR_INVALID_ARGUMENT;
+    }
+    if (!gr_comm) {
+        return MIMPI_ERROR_REMOTE_FINISHED;
+    }
+    int alg = coll_choose(COLL_REDUCE, bytes);
+    if (alg != ALG_HEAP) {
+        return reduce_tree(NULL, alg, send_data, recv_data, bytes, datatype, op, root_reduce);
+    }
+
+    gr_tree t;
+    gr_tree_at(root_reduce, &t);
+    if (!gr_reduce_up(&t, send_data, recv_data, bytes, datatype, op)) {
+        gr_abort(&t);
+        return coll_notify_abort();
+    }
+
+    if (gr_status_down(&t) == GR_FINALIZE) {
+        gr_close(&t);
+        return coll_notify_abort();
+    }
+    return MIMPI_SUCCESS;
+}
+
+MIMPI_Retcode MIMPI_Reduce_typed(
+        void const *send_data,
+        void *recv_data,
+        int count,
+        MIMPI_Datatype datatype,
+        MIMPI_Op op,
+        int root_reduce
+) {
+    coll_sync();
+    return reduce(send_data, recv_data, count, datatype, op, root_reduce);
+}
+
+MIMPI_Retcode MIMPI_Reduce(
+        void const *send_data,
+        void *recv_data,
+        int count,
+        MIMPI_Op op,
+        int root
+) {
+    return MIMPI_Reduce_typed(send_data, recv_data, count, MIMPI_UINT8, op, root);
+}
+
+// Reduce-scatter followed by allgather around the ring of ranks. The result
+// is cut into world_size blocks. In step s of reduce-scatter every process
+// passes its partial result of block rank - s to the next process, which
+// reduces it into its own. After world_size - 1 steps block rank + 1 is
+// complete at every process, and the complete blocks travel around the ring
+// the same way. Every process sends and reduces 2 (n - 1) / n of the payload.
+static MIMPI_Retcode allreduce_ring(void const* send_data, void* recv_data, int count,
+                                    MIMPI_Datatype datatype, MIMPI_Op op) {
+    MIMPI_Retcode res = MIMPI_SUCCESS;
+    int tag = coll_next_tag();
+    size_t elem = datatype_size[datatype];
+    int next = (rank + 1) % world_size;
+    int prev = (rank - 1 + world_size) % world_size;
+    char* result = recv_data;
+    memcpy(result, send_data, count * elem);
+    char* partial = malloc((count / world_size + 1) * elem);
+    assert(partial != NULL);
 
-        ASSERT_SYS_OK(sem_wait(&rec_data.mutex));
-        if (rec_data.other_waiting[destination].tag == tag && rec_data.other_waiting[destination].count == count) {
-            rec_data.other_waiting[destination].tag = -1;
-            rec_data.other_waiting[destination].count = -1;
-        }
+    for (int step = 0; step < 2 * (world_size - 1) && res == MIMPI_SUCCESS; step++) {
+        bool scatter = step < world_size - 1;
+        int out_block = (rank - step + 2 * world_size) % world_size;
+        int in_block = (out_block - 1 + world_size) % world_size;
+        size_t out_first = (size_t)count * out_block / world_size;
+        size_t out_size = (size_t)count * (out_block + 1) / world_size - out_first;
+        size_t in_first = (size_t)count * in_block / world_size;
+        size_t in_size = (size_t)count * (in_block + 1) / world_size - in_first;
 
-        else {
-            add_sent_queue(destination, md);
+        request* send = coll_isend(result + out_first * elem, out_size * elem, next, tag);
+        char* in = scatter ? partial : result + in_first * elem;
+        coll_wait(coll_irecv(in, in_size * elem, prev, tag), &res);
+        if (res == MIMPI_SUCCESS && scatter) {
+            reduce_kernels[datatype][op](result + in_first * elem, partial, in_size);
         }
-        ASSERT_SYS_OK(sem_post(&rec_data.mutex));
+        coll_wait(send, &res);
     }
+    free(partial);
+    return res;
+}
 
+static MIMPI_Retcode allreduce_tree(communicator* comm, int alg, void const* send_data, void* recv_data,
+                                    int bytes, MIMPI_Datatype datatype, MIMPI_Op op) {
+    coll_tree t;
+    coll_tree_in(comm, alg, 0, &t);
+    int tag = coll_tag_in(comm);
+    MIMPI_Retcode res = coll_reduce_up(&t, send_data, recv_data, bytes, datatype, op, tag);
+    if (res == MIMPI_SUCCESS) {
+        res = coll_send_down(&t, recv_data, bytes, tag);
+    }
+    free(t.child);
+    return res;
+}
 
-    if (trysend(ppfdout(destination), &md, sizeof(metadata)) == MIMPI_ERROR_REMOTE_FINISHED) {
-        return MIMPI_ERROR_REMOTE_FINISHED;
+MIMPI_Retcode MIMPI_Allreduce_typed(
+        void const *send_data,
+        void *recv_data,
+        int count,
+        MIMPI_Datatype datatype,
+        MIMPI_Op op
+) {
+    coll_sync();
+    int bytes = typed_bytes(count, datatype, op);
+    if (bytes < 0) {
+        return MIMPI_ERROR_INVALID_ARGUMENT;
     }
-    if (trysend(ppfdout(destination), data, count) == MIMPI_ERROR_REMOTE_FINISHED) {
+    if (!gr_comm) {
         return MIMPI_ERROR_REMOTE_FINISHED;
     }
+    int alg = coll_choose(COLL_ALLREDUCE, bytes);
+    if (alg == ALG_RING) {
+        return allreduce_ring(send_data, recv_data, count, datatype, op);
+    }
+    if (alg != ALG_HEAP) {
+        return allreduce_tree(NULL, alg, send_data, recv_data, bytes, datatype, op);
+    }
 
+    // the result goes down the way the payload of a broadcast does
+    gr_tree t;
+    gr_tree_at(0, &t);
+    if (!gr_reduce_up(&t, send_data, recv_data, bytes, datatype, op)) {
+        gr_abort(&t);
+        return coll_notify_abort();
+    }
+    if (gr_send_data_down(&t, recv_data, bytes) == GR_FINALIZE) {
+        gr_close(&t);
+        return coll_notify_abort();
+    }
     return MIMPI_SUCCESS;
 }
 
-
-MIMPI_Retcode MIMPI_Recv(
-        void *data,
+MIMPI_Retcode MIMPI_Allreduce(
+        void const *send_data,
+        void *recv_data,
         int count,
-        int source,
-        int tag
+        MIMPI_Op op
 ) {
-    if (source == rank) {
-        return MIMPI_ERROR_ATTEMPTED_SELF_OP;
+    return MIMPI_Allreduce_typed(send_data, recv_data, count, MIMPI_UINT8, op);
+}
+
+// Blocks of all processes of a subtree, one after another in depth-first
+// order of the subtree. data[0] is left for the status of the group tree,
+// so that it travels in one message with the blocks.
+struct coll_blocks {
+    int size;
+    int* order;
+    size_t* offset;
+    char* data;
+};
+typedef struct coll_blocks coll_blocks;
+
+// Lists ranks of the subtree of a process in depth-first order, children
+// in the order the tree lists them. Returns the index after the last one.
+static int coll_subtree(int alg, int root_rank, int of_rank, int* order, int at) {
+    order[at++] = of_rank;
+    if (alg == ALG_HEAP) {
+        int pos = of_rank + 1;
+        int toward = gr_toward(pos, root_rank + 1);
+        int neighbours[3] = {pos / 2, pos * 2, pos * 2 + 1};
+        for (int i = 0; i < 3; i++) {
+            if (neighbours[i] >= 1 && neighbours[i] <= world_size && neighbours[i] != toward) {
+                at = coll_subtree(alg, root_rank, neighbours[i] - 1, order, at);
+            }
+        }
+        return at;
     }
+    coll_tree t;
+    coll_tree_of(alg, world_size, root_rank, of_rank, &t);
+    for (int i = 0; i < t.children; i++) {
+        at = coll_subtree(alg, root_rank, t.child[i], order, at);
+    }
+    free(t.child);
+    return at;
+}
 
-    if (source < 0 || source >= world_size) {
-        return MIMPI_ERROR_NO_SUCH_RANK;
+static void blocks_init(coll_blocks* b, int alg, int root_rank, int of_rank, int const* counts) {
+    b->order = (int*) malloc(world_size * sizeof(int));
+    b->offset = (size_t*) malloc((world_size + 1) * sizeof(size_t));
+    assert(b->order != NULL && b->offset != NULL);
+    b->size = coll_subtree(alg, root_rank, of_rank, b->order, 0);
+    b->offset[0] = 0;
+    for (int i = 0; i < b->size; i++) {
+        b->offset[i + 1] = b->offset[i] + counts[b->order[i]];
     }
+    b->data = malloc(sizeof(char) + b->offset[b->size]);
+    assert(b->data != NULL);
+}
 
-    int res = take_from_queue(data, count, source, tag);
-    if (res == 0) {
-        return MIMPI_ERROR_REMOTE_FINISHED;
+static void blocks_free(coll_blocks* b) {
+    free(b->order);
+    free(b->offset);
+    free(b->data);
+}
+
+static char* blocks_at(coll_blocks* b, int index) {
+    return b->data + sizeof(char) + b->offset[index];
+}
+
+// Range [*from, *to) of blocks of the subtree of the i-th of given children.
+static void blocks_child(coll_blocks* b, int const* children, int children_count, int i, int* from, int* to) {
+    *from = 0;
+    while (b->order[*from] != children[i]) {
+        (*from)++;
     }
-    else if (res == MIMPI_ERROR_DEADLOCK_DETECTED) {
-        return MIMPI_ERROR_DEADLOCK_DETECTED;
+    *to = *from + 1;
+    while (*to < b->size && (i + 1 == children_count || b->order[*to] != children[i + 1])) {
+        (*to)++;
     }
-
-    return MIMPI_SUCCESS;
 }
 
-MIMPI_Retcode MIMPI_Barrier() {
-    if (!gr_comm) {
-        return MIMPI_ERROR_REMOTE_FINISHED;
+static void blocks_pack(coll_blocks* b, void const* data, int const* displs) {
+    for (int i = 0; i < b->size; i++) {
+        memcpy(blocks_at(b, i), (const char*)data + displs[b->order[i]], b->offset[i + 1] - b->offset[i]);
     }
+}
 
-    int treepos = rank + 1;
-    int root = treepos / 2;
-    int leftc = treepos * 2;
-    int rightc = treepos * 2 + 1;
+static void blocks_unpack(coll_blocks* b, void* data, int const* displs) {
+    for (int i = 0; i < b->size; i++) {
+        memcpy((char*)data + displs[b->order[i]], blocks_at(b, i), b->offset[i + 1] - b->offset[i]);
+    }
+}
 
-    char comm1 = GR_READY, comm2 = GR_READY;
-    if (leftc <= world_size) {
-        tryrecv(GR_LEFT_IN, &comm1, sizeof(char));
+// Every process sends the blocks of its subtree to the parent in one message.
+static MIMPI_Retcode coll_gather_up(coll_tree* t, coll_blocks* b, int tag) {
+    MIMPI_Retcode res = MIMPI_SUCCESS;
+    request** recvs = (request**) malloc((t->children + 1) * sizeof(request*));
+    assert(recvs != NULL);
+    for (int i = 0; i < t->children; i++) {
+        int from, to;
+        blocks_child(b, t->child, t->children, i, &from, &to);
+        recvs[i] = coll_irecv(blocks_at(b, from), b->offset[to] - b->offset[from], t->child[i], tag);
+    }
+    for (int i = 0; i < t->children; i++) {
+        coll_wait(recvs[i], &res);
     }
+    free(recvs);
+    if (res == MIMPI_SUCCESS && t->parent != -1) {
+        coll_wait(coll_isend(blocks_at(b, 0), b->offset[b->size], t->parent, tag), &res);
+    }
+    return res;
+}
 
-    if (rightc <= world_size) {
-        tryrecv(GR_RIGHT_IN, &comm2, sizeof(char));
+// Every process gets the blocks of its subtree from the parent in one message.
+static MIMPI_Retcode coll_scatter_down(coll_tree* t, coll_blocks* b, int tag) {
+    MIMPI_Retcode res = MIMPI_SUCCESS;
+    if (t->parent != -1) {
+        coll_wait(coll_irecv(blocks_at(b, 0), b->offset[b->size], t->parent, tag), &res);
+    }
+    if (res != MIMPI_SUCCESS) {
+        return res;
+    }
+    request** sends = (request**) malloc((t->children + 1) * sizeof(request*));
+    assert(sends != NULL);
+    for (int i = 0; i < t->children; i++) {
+        int from, to;
+        blocks_child(b, t->child, t->children, i, &from, &to);
+        sends[i] = coll_isend(blocks_at(b, from), b->offset[to] - b->offset[from], t->child[i], tag);
     }
+    for (int i = 0; i < t->children; i++) {
+        coll_wait(sends[i], &res);
+    }
+    free(sends);
+    return res;
+}
 
-    if (comm1 == GR_FINALIZE || comm2 == GR_FINALIZE) {
-        char mycomm = GR_FINALIZE;
-        gr_comm = false;
-        if (root > 0) {
-            trysend(GR_ROOT_OUT, &mycomm, sizeof(char));
-            ASSERT_SYS_OK(close(GR_ROOT_IN));
-            ASSERT_SYS_OK(close(GR_ROOT_OUT));
-        }
-        if (leftc <= world_size) {
-            trysend(GR_LEFT_OUT, &mycomm, sizeof(char));
-            ASSERT_SYS_OK(close(GR_LEFT_IN));
-            ASSERT_SYS_OK(close(GR_LEFT_OUT));
-        }
-        if (rightc <= world_size) {
-            trysend(GR_RIGHT_OUT, &mycomm, sizeof(char));
-            ASSERT_SYS_OK(close(GR_RIGHT_IN));
-            ASSERT_SYS_OK(close(GR_RIGHT_OUT));
+// Blocks of the subtree go up the group tree behind the status, in one
+// message. Returns false if a child reported a finished process, which
+// sends nothing more.
+static bool gr_gather_up(gr_tree* t, coll_blocks* b) {
+    bool finished = false;
+    for (int i = 0; i < t->children; i++) {
+        char comm = GR_READY;
+        tryrecv(t->child_in[i], &comm, sizeof(char));
+        if (comm == GR_FINALIZE) {
+            finished = true;
+            continue;
         }
-        return MIMPI_ERROR_REMOTE_FINISHED;
+        int from, to;
+        blocks_child(b, t->child_rank, t->children, i, &from, &to);
+        tryrecv(t->child_in[i], blocks_at(b, from), b->offset[to] - b->offset[from]);
     }
-
-    char mycomm = GR_READY;
-
-    if (root > 0) {
-        trysend(GR_ROOT_OUT, &mycomm, sizeof(char));
-        tryrecv(GR_ROOT_IN, &mycomm, sizeof(char));
+    if (finished) {
+        return false;
     }
+    if (t->parent_in != -1) {
+        b->data[0] = GR_READY;
+        trysend(t->parent_out, b->data, sizeof(char) + b->offset[b->size]);
+    }
+    return true;
+}
 
-    if (leftc <= world_size) {
-        trysend(GR_LEFT_OUT, &mycomm, sizeof(char));
+// Every child gets the blocks of its subtree behind the status, in one
+// message. The own block is taken out first, as the status takes the place
+// of the byte just before the blocks of a child, which belongs to data
+// already passed on. Returns the status.
+static char gr_scatter_down(gr_tree* t, coll_blocks* b, void* own) {
+    if (t->parent_in != -1) {
+        tryrecv(t->parent_in, b->data, sizeof(char) + b->offset[b->size]);
     }
-    if (rightc <= world_size) {
-        trysend(GR_RIGHT_OUT, &mycomm, sizeof(char));
+    else {
+        b->data[0] = GR_READY;
+    }
+    char mycomm = b->data[0];
+    if (mycomm != GR_FINALIZE) {
+        memcpy(own, blocks_at(b, 0), b->offset[1]);
     }
+    for (int i = 0; i < t->children; i++) {
+        int from, to;
+        blocks_child(b, t->child_rank, t->children, i, &from, &to);
+        char* message = blocks_at(b, from) - sizeof(char);
+        message[0] = mycomm;
+        trysend(t->child_out[i], message, sizeof(char) + b->offset[to] - b->offset[from]);
+    }
+    return mycomm;
+}
 
-    if (mycomm == GR_FINALIZE) {
-        gr_comm = false;
-        if (root > 0) {
-            ASSERT_SYS_OK(close(GR_ROOT_IN));
-            ASSERT_SYS_OK(close(GR_ROOT_OUT));
-        }
-        if (leftc <= world_size) {
-            ASSERT_SYS_OK(close(GR_LEFT_IN));
-            ASSERT_SYS_OK(close(GR_LEFT_OUT));
-        }
-        if (rightc <= world_size) {
-            ASSERT_SYS_OK(close(GR_RIGHT_IN));
-            ASSERT_SYS_OK(close(GR_RIGHT_OUT));
-        }
-        return MIMPI_ERROR_REMOTE_FINISHED;
+static int* uniform_counts(int count) {
+    int* counts = (int*) malloc(2 * world_size * sizeof(int));
+    assert(counts != NULL);
+    for (int i = 0; i < world_size; i++) {
+        counts[i] = count;
+        counts[world_size + i] = i * count;
     }
-    return MIMPI_SUCCESS;
+    return counts;
 }
 
-MIMPI_Retcode MIMPI_Bcast(
-        void *data,
+static size_t total_count(int const* counts) {
+    size_t total = 0;
+    for (int i = 0; i < world_size; i++) {
+        total += counts[i];
+    }
+    return total;
+}
+
+MIMPI_Retcode MIMPI_Gatherv(
+        void const *send_data,
         int count,
-        int root_bcast
+        void *recv_data,
+        int const *recv_counts,
+        int const *displs,
+        int root
 ) {
+    coll_sync();
+    if (root < 0 || root >= world_size) {
+        return MIMPI_ERROR_NO_SUCH_RANK;
+    }
+    // the block of the calling process is sized from recv_counts
+    if (count != recv_counts[rank]) {
+        return MIMPI_ERROR_INVALID_ARGUMENT;
+    }
     if (!gr_comm) {
         return MIMPI_ERROR_REMOTE_FINISHED;
     }
+    int alg = coll_choose(COLL_GATHER, total_count(recv_counts));
+    coll_blocks b;
+    blocks_init(&b, alg, root, rank, recv_counts);
+    memcpy(blocks_at(&b, 0), send_data, count);
 
-    int treepos = rank + 1;
-    int root = treepos / 2;
-    int leftc = treepos * 2;
-    int rightc = treepos * 2 + 1;
-
-    char comm1 = GR_READY, comm2 = GR_READY;
-    if (leftc <= world_size) {
-        tryrecv(GR_LEFT_IN, &comm1, sizeof(char));
+    MIMPI_Retcode res = MIMPI_SUCCESS;
+    if (alg != ALG_HEAP) {
+        // the root releases everybody once it has all blocks
+        coll_tree t;
+        coll_tree_at(alg, root, &t);
+        int tag = coll_next_tag();
+        res = coll_gather_up(&t, &b, tag);
+        if (res == MIMPI_SUCCESS && rank == root) {
+            blocks_unpack(&b, recv_data, displs);
+        }
+        if (res == MIMPI_SUCCESS) {
+            res = coll_tree_down(&t, tag);
+        }
+        free(t.child);
+        blocks_free(&b);
+        return res;
     }
 
-    if (rightc <= world_size) {
-        tryrecv(GR_RIGHT_IN, &comm2, sizeof(char));
+    gr_tree t;
+    gr_tree_at(root, &t);
+    if (!gr_gather_up(&t, &b)) {
+        blocks_free(&b);
+        gr_abort(&t);
+        return coll_notify_abort();
+    }
+    if (rank == root) {
+        blocks_unpack(&b, recv_data, displs);
+    }
+    blocks_free(&b);
+    if (gr_status_down(&t) == GR_FINALIZE) {
+        gr_close(&t);
+        return coll_notify_abort();
     }
+    return res;
+}
 
-    if (comm1 == GR_FINALIZE || comm2 == GR_FINALIZE) {
-        char comm = GR_FINALIZE;
-        gr_comm = false;
-        if (root > 0) {
-            trysend(GR_ROOT_OUT, &comm, sizeof(char));
-            ASSERT_SYS_OK(close(GR_ROOT_IN));
-            ASSERT_SYS_OK(close(GR_ROOT_OUT));
-        }
-        if (leftc <= world_size) {
-            trysend(GR_LEFT_OUT, &comm, sizeof(char));
-            ASSERT_SYS_OK(close(GR_LEFT_IN));
-            ASSERT_SYS_OK(close(GR_LEFT_OUT));
-        }
-        if (rightc <= world_size) {
-            trysend(GR_RIGHT_OUT, &comm, sizeof(char));
-            ASSERT_SYS_OK(close(GR_RIGHT_IN));
-            ASSERT_SYS_OK(close(GR_RIGHT_OUT));
-        }
+MIMPI_Retcode MIMPI_Gather(
+        void const *send_data,
+        void *recv_data,
+        int count,
+        int root
+) {
+    int* counts = uniform_counts(count);
+    MIMPI_Retcode res = MIMPI_Gatherv(send_data, count, recv_data, counts, counts + world_size, root);
+    free(counts);
+    return res;
+}
+
+MIMPI_Retcode MIMPI_Scatterv(
+        void const *send_data,
+        int const *send_counts,
+        int const *displs,
+        void *recv_data,
+        int count,
+        int root
+) {
+    coll_sync();
+    if (root < 0 || root >= world_size) {
+        return MIMPI_ERROR_NO_SUCH_RANK;
+    }
+    if (count != send_counts[rank]) {
+        return MIMPI_ERROR_INVALID_ARGUMENT;
+    }
+    if (!gr_comm) {
         return MIMPI_ERROR_REMOTE_FINISHED;
     }
+    int alg = coll_choose(COLL_SCATTER, total_count(send_counts));
+    coll_blocks b;
+    blocks_init(&b, alg, root, rank, send_counts);
+    if (rank == root) {
+        blocks_pack(&b, send_data, displs);
+    }
 
-    char mycomm = GR_READY;
-    void* recv = malloc(sizeof(char) + count);
-    if (root == 0) {
-        if (root_bcast == rank) {
-            memcpy(recv, &mycomm, sizeof(char));
-            memcpy(recv+sizeof(char), data, count);
+    MIMPI_Retcode res = MIMPI_SUCCESS;
+    if (alg != ALG_HEAP) {
+        // blocks only go down once every process reported readiness
+        coll_tree t;
+        coll_tree_at(alg, root, &t);
+        int tag = coll_next_tag();
+        res = coll_tree_up(&t, tag);
+        if (res == MIMPI_SUCCESS) {
+            res = coll_scatter_down(&t, &b, tag);
         }
-        else {
-            tryrecv(GR_DATA_IN, recv + sizeof(char), count);
-            ((char*)recv)[0] = mycomm;
+        if (res == MIMPI_SUCCESS) {
+            memcpy(recv_data, blocks_at(&b, 0), count);
         }
+        free(t.child);
+        blocks_free(&b);
+        return res;
     }
 
-    else if (root > 0) {
-        trysend(GR_ROOT_OUT, &mycomm, sizeof(char));
-        if (root_bcast == rank) {
-            trysend(grdatafdout(0), data, count);
-        }
+    gr_tree t;
+    gr_tree_at(root, &t);
+    if (!gr_status_up(&t)) {
+        blocks_free(&b);
+        gr_abort(&t);
+        return coll_notify_abort();
+    }
+    char mycomm = gr_scatter_down(&t, &b, recv_data);
+    blocks_free(&b);
+    if (mycomm == GR_FINALIZE) {
+        gr_close(&t);
+        return coll_notify_abort();
+    }
+    return res;
+}
+
+MIMPI_Retcode MIMPI_Scatter(
+        void const *send_data,
+        void *recv_data,
+        int count,
+        int root
+) {
+    int* counts = uniform_counts(count);
+    MIMPI_Retcode res = MIMPI_Scatterv(send_data, counts, counts + world_size, recv_data, count, root);
+    free(counts);
+    return res;
+}
 
-        tryrecv(GR_ROOT_IN, recv, sizeof(char)+count);
-        memcpy(&mycomm, recv, sizeof(char));
+// In step s every process passes block rank - s on to the next process,
+// which after world_size - 1 steps has every block.
+static MIMPI_Retcode allgather_ring(void* recv_data, int const* counts, int const* displs) {
+    MIMPI_Retcode res = MIMPI_SUCCESS;
+    int tag = coll_next_tag();
+    int next = (rank + 1) % world_size;
+    int prev = (rank - 1 + world_size) % world_size;
+    for (int step = 0; step < world_size - 1 && res == MIMPI_SUCCESS; step++) {
+        int out = (rank - step + world_size) % world_size;
+        int in = (out - 1 + world_size) % world_size;
+        request* send = coll_isend((char*)recv_data + displs[out], counts[out], next, tag);
+        coll_wait(coll_irecv((char*)recv_data + displs[in], counts[in], prev, tag), &res);
+        coll_wait(send, &res);
     }
+    return res;
+}
 
-    if (leftc <= world_size) {
-        trysend(GR_LEFT_OUT, recv, sizeof(char) + count);
+MIMPI_Retcode MIMPI_Allgatherv(
+        void const *send_data,
+        int count,
+        void *recv_data,
+        int const *recv_counts,
+        int const *displs
+) {
+    coll_sync();
+    if (count != recv_counts[rank]) {
+        return MIMPI_ERROR_INVALID_ARGUMENT;
+    }
+    if (!gr_comm) {
+        return MIMPI_ERROR_REMOTE_FINISHED;
     }
-    if (rightc <= world_size) {
-        trysend(GR_RIGHT_OUT, recv, sizeof(char) + count);
+    size_t total = total_count(recv_counts);
+    int alg = coll_choose(COLL_ALLGATHER, total);
+    if (alg == ALG_RING) {
+        memcpy((char*)recv_data + displs[rank], send_data, count);
+        return allgather_ring(recv_data, recv_counts, displs);
     }
 
-    if (mycomm == GR_FINALIZE) {
-        gr_comm = false;
-        if (root > 0) {
-            ASSERT_SYS_OK(close(GR_ROOT_IN));
-            ASSERT_SYS_OK(close(GR_ROOT_OUT));
-        }
-        if (leftc <= world_size) {
-            ASSERT_SYS_OK(close(GR_LEFT_IN));
-            ASSERT_SYS_OK(close(GR_LEFT_OUT));
-        }
-        if (rightc <= world_size) {
-            ASSERT_SYS_OK(close(GR_RIGHT_IN));
-            ASSERT_SYS_OK(close(GR_RIGHT_OUT));
+    // Blocks get gathered at rank 0, then all of them go down the tree
+    // the way the payload of a broadcast does.
+    coll_blocks b, all;
+    blocks_init(&b, alg, 0, rank, recv_counts);
+    memcpy(blocks_at(&b, 0), send_data, count);
+    coll_blocks* whole = &b;
+    if (rank != 0) {
+        blocks_init(&all, alg, 0, 0, recv_counts);
+        whole = &all;
+    }
+
+    MIMPI_Retcode res = MIMPI_SUCCESS;
+    if (alg != ALG_HEAP) {
+        coll_tree t;
+        coll_tree_at(alg, 0, &t);
+        int tag = coll_next_tag();
+        res = coll_gather_up(&t, &b, tag);
+        if (res == MIMPI_SUCCESS) {
+            res = coll_send_down(&t, blocks_at(whole, 0), total, tag);
         }
-        free(recv);
-        return MIMPI_ERROR_REMOTE_FINISHED;
+        free(t.child);
     }
     else {
-        memcpy(data, recv+sizeof(char), count);
-        free(recv);
-    }
-    return MIMPI_SUCCESS;
-}
-
-static void exec_MIMPI_Op(uint8_t* res, const uint8_t* data1, const  uint8_t* data2, const uint8_t* data3, int count, MIMPI_Op op) {
-    for (int i = 0; i < count; i++) {
-        uint8_t cell = data1[i];
-        if (data2) {
-            if (op == MIMPI_MAX) {
-                cell = cell > data2[i] ? cell : data2[i];
-            }
-            else if (op == MIMPI_MIN) {
-                cell = cell < data2[i] ? cell : data2[i];
-            }
-            else if (op == MIMPI_SUM) {
-                cell += data2[i];
-            }
-            else {
-                cell *= data2[i];
-            }
+        gr_tree t;
+        gr_tree_at(0, &t);
+        if (!gr_gather_up(&t, &b)) {
+            gr_abort(&t);
+            res = coll_notify_abort();
         }
-        if (data3) {
-            if (op == MIMPI_MAX) {
-                cell = cell > data3[i] ? cell : data3[i];
-            }
-            else if (op == MIMPI_MIN) {
-                cell = cell < data3[i] ? cell : data3[i];
-            }
-            else if (op == MIMPI_SUM) {
-                cell += data3[i];
-            }
-            else {
-                cell *= data3[i];
-            }
+        else if (gr_send_data_down(&t, blocks_at(whole, 0), total) == GR_FINALIZE) {
+            gr_close(&t);
+            res = coll_notify_abort();
         }
+    }
 
-        res[i] = cell;
+    if (res == MIMPI_SUCCESS) {
+        blocks_unpack(whole, recv_data, displs);
     }
+    blocks_free(&b);
+    if (rank != 0) {
+        blocks_free(&all);
+    }
+    return res;
 }
 
-MIMPI_Retcode MIMPI_Reduce(
+MIMPI_Retcode MIMPI_Allgather(
         void const *send_data,
         void *recv_data,
-        int count,
-        MIMPI_Op op,
-        int root_reduce
+        int count
+) {
+    int* counts = uniform_counts(count);
+    MIMPI_Retcode res = MIMPI_Allgatherv(send_data, count, recv_data, counts, counts + world_size);
+    free(counts);
+    return res;
+}
+
+// Pairwise exchange: in step s every process trades blocks with one peer
+// only, rank ^ s if the world size is a power of two, otherwise it sends
+// to rank + s and receives from rank - s. No peer gets blocks from two
+// processes at once, and sends wait in outboxes rather than in full pipes.
+MIMPI_Retcode MIMPI_Alltoallv(
+        void const *send_data,
+        int const *send_counts,
+        int const *send_displs,
+        void *recv_data,
+        int const *recv_counts,
+        int const *recv_displs
 ) {
+    coll_sync();
     if (!gr_comm) {
         return MIMPI_ERROR_REMOTE_FINISHED;
     }
+    memcpy((char*)recv_data + recv_displs[rank], (const char*)send_data + send_displs[rank], send_counts[rank]);
 
-    int treepos = rank + 1;
-    int root = treepos / 2;
-    int leftc = treepos * 2;
-    int rightc = treepos * 2 + 1;
-
-    void* comm1 = NULL;
-    void* comm2 = NULL;
-    if (leftc <= world_size) {
-        comm1 = malloc(count + 1);
-        tryrecv(GR_LEFT_IN, comm1, count + sizeof(char));
+    MIMPI_Retcode res = MIMPI_SUCCESS;
+    int tag = coll_next_tag();
+    bool xor = (world_size & (world_size - 1)) == 0;
+    for (int step = 1; step < world_size && res == MIMPI_SUCCESS; step++) {
+        int dest = xor ? rank ^ step : (rank + step) % world_size;
+        int source = xor ? rank ^ step : (rank - step + world_size) % world_size;
+        request* recv = coll_irecv((char*)recv_data + recv_displs[source], recv_counts[source], source, tag);
+        request* send = coll_isend((const char*)send_data + send_displs[dest], send_counts[dest], dest, tag);
+        coll_wait(recv, &res);
+        coll_wait(send, &res);
     }
+    return res;
+}
 
-    if (rightc <= world_size) {
-        comm2 = malloc(count + 1);
-        tryrecv(GR_RIGHT_IN, comm2, count + sizeof(char));
-    }
+MIMPI_Retcode MIMPI_Alltoall(
+        void const *send_data,
+        void *recv_data,
+        int count
+) {
+    int* counts = uniform_counts(count);
+    MIMPI_Retcode res = MIMPI_Alltoallv(send_data, counts, counts + world_size,
+                                        recv_data, counts, counts + world_size);
+    free(counts);
+    return res;
+}
 
-    char stat1 = comm1 == NULL ? GR_READY : *(char*)comm1;
-    char stat2 = comm2 == NULL ? GR_READY : *(char*)comm2;
-    if (stat1 == GR_FINALIZE || stat2 == GR_FINALIZE) {
-        char comm = GR_FINALIZE;
-        gr_comm = false;
-        if (root > 0) {
-            trysend(GR_ROOT_OUT, &comm, sizeof(char));
-            ASSERT_SYS_OK(close(GR_ROOT_IN));
-            ASSERT_SYS_OK(close(GR_ROOT_OUT));
-        }
-        if (leftc <= world_size) {
-            trysend(GR_LEFT_OUT, &comm, sizeof(char));
-            ASSERT_SYS_OK(close(GR_LEFT_IN));
-            ASSERT_SYS_OK(close(GR_LEFT_OUT));
+static void* coll_progress(void* arg) {
+    (void) arg;
+    while (true) {
+        ASSERT_SYS_OK(sem_wait(&coll_queue_ready));
+        ASSERT_SYS_OK(sem_wait(&coll_queue_mutex));
+        coll_op* op = coll_queue_head;
+        coll_queue_head = op->next;
+        if (coll_queue_head == NULL) {
+            coll_queue_tail = NULL;
         }
-        if (rightc <= world_size) {
-            trysend(GR_RIGHT_OUT, &comm, sizeof(char));
-            ASSERT_SYS_OK(close(GR_RIGHT_IN));
-            ASSERT_SYS_OK(close(GR_RIGHT_OUT));
+        ASSERT_SYS_OK(sem_post(&coll_queue_mutex));
+
+        MIMPI_Retcode res = MIMPI_SUCCESS;
+        switch (op->kind) {
+            case OP_BARRIER:
+                res = barrier();
+                break;
+            case OP_BCAST:
+                res = bcast(op->data, op->count, op->root);
+                break;
+            case OP_REDUCE:
+                res = reduce(op->send_data, op->data, op->count, MIMPI_UINT8, op->op, op->root);
+                break;
+            case OP_STOP:
+                free(op);
+                return NULL;
         }
-        free(comm1);
-        free(comm2);
-        return MIMPI_ERROR_REMOTE_FINISHED;
+        complete(op->req, res);
+        free(op);
+    }
+}
+
+// Queues a collective for the collective thread, starting it first if needed.
+static MIMPI_Request coll_start(coll_op* op) {
+    batch_flush_all();
+    if (!coll_thread_running) {
+        ASSERT_SYS_OK(sem_init(&coll_queue_mutex, 0, 1));
+        ASSERT_SYS_OK(sem_init(&coll_queue_ready, 0, 0));
+        ASSERT_ZERO(pthread_create(&coll_thread, NULL, coll_progress, NULL));
+        coll_thread_running = true;
     }
+    op->req = new_request(REQ_COLL, -1, TAG_COLL, op->count, op->data);
+    MIMPI_Request req = op->req;
+    coll_enqueue(op);
+    return req;
+}
 
-    char mycomm = GR_READY;
-    void* data1 = comm1 == NULL ? NULL : comm1+1;
-    void* data2 = comm2 == NULL ? NULL : comm2+1;
-    void* res = malloc(count + 1);
-    *(char*)res = GR_READY;
-    exec_MIMPI_Op(res+1, send_data, data1, data2, count, op);
-    free(comm1);
-    free(comm2);
-    if (root > 0) {
-        trysend(GR_ROOT_OUT, res, count + 1);
-        // free(res);
+static coll_op* new_coll_op(int kind, const void* send_data, void* data, int count, MIMPI_Op mimpi_op, int root) {
+    coll_op* op = (coll_op*) malloc(sizeof(coll_op));
+    assert(op != NULL);
+    op->kind = kind;
+    op->send_data = send_data;
+    op->data = data;
+    op->count = count;
+    op->op = mimpi_op;
+    op->root = root;
+    return op;
+}
+
+MIMPI_Retcode MIMPI_Ibarrier(MIMPI_Request *request) {
+    *request = coll_start(new_coll_op(OP_BARRIER, NULL, NULL, 0, MIMPI_MAX, 0));
+    return MIMPI_SUCCESS;
+}
 
-        tryrecv(GR_ROOT_IN, &mycomm, sizeof(char));
+MIMPI_Retcode MIMPI_Ibcast(
+        void *data,
+        int count,
+        int root,
+        MIMPI_Request *request
+) {
+    if (root < 0 || root >= world_size) {
+        *request = MIMPI_REQUEST_NULL;
+        return MIMPI_ERROR_NO_SUCH_RANK;
     }
+    *request = coll_start(new_coll_op(OP_BCAST, NULL, data, count, MIMPI_MAX, root));
+    return MIMPI_SUCCESS;
+}
 
-    if (leftc <= world_size) {
-        trysend(GR_LEFT_OUT, &mycomm, sizeof(char));
+MIMPI_Retcode MIMPI_Ireduce(
+        void const *send_data,
+        void *recv_data,
+        int count,
+        MIMPI_Op op,
+        int root,
+        MIMPI_Request *request
+) {
+    if (root < 0 || root >= world_size) {
+        *request = MIMPI_REQUEST_NULL;
+        return MIMPI_ERROR_NO_SUCH_RANK;
     }
-    if (rightc <= world_size) {
-        trysend(GR_RIGHT_OUT, &mycomm, sizeof(char));
+    *request = coll_start(new_coll_op(OP_REDUCE, send_data, recv_data, count, op, root));
+    return MIMPI_SUCCESS;
+}
+
+// Communicators have no heap tree of their own, so their collectives run
+// over p-p channels, in binomial trees unless another tree was chosen.
+static int comm_alg(int collective) {
+    int alg = coll_alg[collective];
+    return alg == ALG_KARY || alg == ALG_RING ? alg : ALG_BINOMIAL;
+}
+
+MIMPI_Retcode MIMPI_Comm_split(int color, int key, MIMPI_Comm *comm) {
+    *comm = MIMPI_COMM_NULL;
+    int slot = comm_splits++ % COMM_SLOTS;
+    int own[2] = {color, key};
+    int* all = (int*) malloc(2 * world_size * sizeof(int));
+    assert(all != NULL);
+    MIMPI_Retcode res = MIMPI_Allgather(own, all, sizeof(own));
+    if (res != MIMPI_SUCCESS || color < 0) {
+        free(all);
+        return res;
     }
 
-    if (mycomm == GR_FINALIZE) {
-        gr_comm = false;
-        if (root > 0) {
-            ASSERT_SYS_OK(close(GR_ROOT_IN));
-            ASSERT_SYS_OK(close(GR_ROOT_OUT));
+    communicator* c = (communicator*) malloc(sizeof(communicator));
+    assert(c != NULL);
+    c->ranks = (int*) malloc(world_size * sizeof(int));
+    assert(c->ranks != NULL);
+    c->size = 0;
+    // members ordered by key, then by world rank
+    for (int i = 0; i < world_size; i++) {
+        if (all[2 * i] != color) {
+            continue;
         }
-        if (leftc <= world_size) {
-            ASSERT_SYS_OK(close(GR_LEFT_IN));
-            ASSERT_SYS_OK(close(GR_LEFT_OUT));
+        int at = c->size++;
+        while (at > 0 && all[2 * c->ranks[at - 1] + 1] > all[2 * i + 1]) {
+            c->ranks[at] = c->ranks[at - 1];
+            at--;
         }
-        if (rightc <= world_size) {
-            ASSERT_SYS_OK(close(GR_RIGHT_IN));
-            ASSERT_SYS_OK(close(GR_RIGHT_OUT));
+        c->ranks[at] = i;
+    }
+    for (int i = 0; i < c->size; i++) {
+        if (c->ranks[i] == rank) {
+            c->rank = i;
         }
-        free(res);
-        return MIMPI_ERROR_REMOTE_FINISHED;
     }
+    c->tag_base = TAG_COLL - COLL_TAGS - slot * COMM_TAGS;
+    c->seq = 0;
+    free(all);
+    *comm = c;
+    return MIMPI_SUCCESS;
+}
+
+void MIMPI_Comm_free(MIMPI_Comm *comm) {
+    if (*comm == MIMPI_COMM_NULL) {
+        return;
+    }
+    free((*comm)->ranks);
+    free(*comm);
+    *comm = MIMPI_COMM_NULL;
+}
+
+int MIMPI_Comm_rank(MIMPI_Comm comm) {
+    return comm == MIMPI_COMM_NULL ? -1 : comm->rank;
+}
+
+int MIMPI_Comm_size(MIMPI_Comm comm) {
+    return comm == MIMPI_COMM_NULL ? -1 : comm->size;
+}
 
-    if (root == 0 && root_reduce == rank) {
-        memcpy(recv_data, res + 1, count);
+MIMPI_Retcode MIMPI_Comm_barrier(MIMPI_Comm comm) {
+    coll_sync();
+    if (!gr_comm) {
+        return MIMPI_ERROR_REMOTE_FINISHED;
     }
+    return barrier_tree(comm, comm_alg(COLL_BARRIER));
+}
 
-    else if (root == 0) {
-        trysend(grdatafdout(root_reduce), res + 1, count);
+MIMPI_Retcode MIMPI_Comm_bcast(
+        MIMPI_Comm comm,
+        void *data,
+        int count,
+        int root
+) {
+    if (root < 0 || root >= comm->size) {
+        return MIMPI_ERROR_NO_SUCH_RANK;
+    }
+    coll_sync();
+    if (!gr_comm) {
+        return MIMPI_ERROR_REMOTE_FINISHED;
     }
+    return bcast_tree(comm, comm_alg(COLL_BCAST), data, count, root);
+}
 
+MIMPI_Retcode MIMPI_Comm_reduce(
+        MIMPI_Comm comm,
+        void const *send_data,
+        void *recv_data,
+        int count,
+        MIMPI_Datatype datatype,
+        MIMPI_Op op,
+        int root
+) {
+    if (root < 0 || root >= comm->size) {
+        return MIMPI_ERROR_NO_SUCH_RANK;
+    }
+    int bytes = typed_bytes(count, datatype, op);
+    if (bytes < 0) {
+        return MIMPI_ERROR_INVALID_ARGUMENT;
+    }
+    coll_sync();
+    if (!gr_comm) {
+        return MIMPI_ERROR_REMOTE_FINISHED;
+    }
+    return reduce_tree(comm, comm_alg(COLL_REDUCE), send_data, recv_data, bytes, datatype, op, root);
+}
 
-    else if (root_reduce == rank) {
-        tryrecv(GR_DATA_IN, recv_data, count);
+MIMPI_Retcode MIMPI_Comm_allreduce(
+        MIMPI_Comm comm,
+        void const *send_data,
+        void *recv_data,
+        int count,
+        MIMPI_Datatype datatype,
+        MIMPI_Op op
+) {
+    int bytes = typed_bytes(count, datatype, op);
+    if (bytes < 0) {
+        return MIMPI_ERROR_INVALID_ARGUMENT;
+    }
+    coll_sync();
+    if (!gr_comm) {
+        return MIMPI_ERROR_REMOTE_FINISHED;
     }
-    free(res);
+    return allreduce_tree(comm, comm_alg(COLL_ALLREDUCE), send_data, recv_data, bytes, datatype, op);
+}
 
+MIMPI_Retcode MIMPI_Flush() {
+    batch_flush_all();
     return MIMPI_SUCCESS;
-}
\ No newline at end of file
+}
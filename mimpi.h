@@ -4,6 +4,7 @@
 #include <stdbool.h>
 
 #define MIMPI_ANY_TAG 0
+#define MIMPI_ANY_SOURCE -1
 
 /// Return code of MIMPI operations.
 typedef enum {
@@ -12,8 +13,25 @@ typedef enum {
     MIMPI_ERROR_NO_SUCH_RANK = 2, /// no process with requested rank exists in the world
     MIMPI_ERROR_REMOTE_FINISHED = 3, /// the remote process involved in communication has finished
     MIMPI_ERROR_DEADLOCK_DETECTED = 4, /// a deadlock has been detected
+    MIMPI_ERROR_INVALID_ARGUMENT = 5, /// an argument is out of its range
 } MIMPI_Retcode;
 
+/// @brief Handle of a non-blocking operation in progress.
+///
+/// Obtained from @ref MIMPI_Isend() or @ref MIMPI_Irecv() and released
+/// by a call that reports the operation as complete, which sets it
+/// to `MIMPI_REQUEST_NULL`.
+typedef struct MIMPI_Request_s* MIMPI_Request;
+
+#define MIMPI_REQUEST_NULL ((MIMPI_Request) 0)
+
+/// @brief Handle of a group of processes made by @ref MIMPI_Comm_split().
+///
+/// Released by @ref MIMPI_Comm_free(), which sets it to `MIMPI_COMM_NULL`.
+typedef struct MIMPI_Comm_s* MIMPI_Comm;
+
+#define MIMPI_COMM_NULL ((MIMPI_Comm) 0)
+
 /// @brief Reduction operation kind.
 ///
 /// Type of operation performed in @ref MIMPI_Reduce().
@@ -24,6 +42,15 @@ typedef enum {
     MIMPI_PROD,
 } MIMPI_Op;
 
+/// @brief Type of elements reduced by @ref MIMPI_Reduce_typed().
+typedef enum {
+    MIMPI_UINT8,
+    MIMPI_INT32,
+    MIMPI_INT64,
+    MIMPI_FLOAT,
+    MIMPI_DOUBLE,
+} MIMPI_Datatype;
+
 /// @brief Initialises MIMPI framework in MIMPI programs.
 ///
 /// Opens an _MPI block_, permitting use of other MIMPI procedures.
@@ -84,6 +111,8 @@ MIMPI_Retcode MIMPI_Send(
 /// @param data - place where received data is to be put.
 /// @param count - number of bytes of data to be received.
 /// @param source - rank of the process for data from we are waiting. 
+///                 `MIMPI_ANY_SOURCE` receives from any process, see
+///                 @ref MIMPI_Recv_any.
 /// @param tag - a discriminant of the data, which can be used
 ///              to distinguish between messages.
 /// @return MIMPI return code:
@@ -103,6 +132,237 @@ MIMPI_Retcode MIMPI_Recv(
     int tag
 );
 
+/// @brief Receives data from whichever process sends matching data first.
+///
+/// Of the messages matching @ref count and @ref tag, takes the one that
+/// arrived first, no matter which process sent it. If none has arrived yet,
+/// takes the first one to arrive. A receive from a given process posted
+/// earlier gets a message of that process before this one does.
+/// Deadlocks are not detected for receives from any process.
+///
+/// @param source - place where the rank of the sender is to be put,
+///                 may be NULL. Set to `MIMPI_ANY_SOURCE` on error.
+/// @return MIMPI return code:
+///         - `MIMPI_SUCCESS` if operation ended successfully.
+///         - `MIMPI_ERROR_REMOTE_FINISHED` if all other processes
+///           have already escaped _MPI block_.
+///
+MIMPI_Retcode MIMPI_Recv_any(
+    void *data,
+    int count,
+    int tag,
+    int *source
+);
+
+/// @brief Sends data to one process and receives data from another one.
+///
+/// Like @ref MIMPI_Send followed by @ref MIMPI_Recv, but the send does not
+/// have to complete before the receive starts, so processes exchanging data
+/// with their neighbours this way do not wait for each other.
+/// @ref destination and @ref source may be the same process.
+///
+/// @return the first unsuccessful result of the send and the receive,
+///         as @ref MIMPI_Send and @ref MIMPI_Recv return them,
+///         `MIMPI_SUCCESS` if there is none.
+///
+MIMPI_Retcode MIMPI_Sendrecv(
+    void const *send_data,
+    int send_count,
+    int destination,
+    int send_tag,
+    void *recv_data,
+    int recv_count,
+    int source,
+    int recv_tag
+);
+
+/// @brief Sends the same data to several processes.
+///
+/// Like @ref MIMPI_Send to every process in @ref destinations, but all the
+/// sends are in progress at the same time. A failure of one send does not
+/// stop the others.
+///
+/// @param destinations - ranks of the processes who are to receive the data.
+/// @param destinations_count - number of ranks in @ref destinations.
+/// @return the first unsuccessful result in order of @ref destinations,
+///         as @ref MIMPI_Send returns it, `MIMPI_SUCCESS` if there is none.
+///
+MIMPI_Retcode MIMPI_Send_multi(
+    void const *data,
+    int count,
+    int const *destinations,
+    int destinations_count,
+    int tag
+);
+
+/// @brief Sends messages waiting in batches.
+///
+/// With `MIMPI_BATCH_SIZE` set, small messages are copied to a batch of their
+/// destination and sent together later, at the latest when the process
+/// waits for anything. Sends all batches at once instead.
+///
+/// @return `MIMPI_SUCCESS`.
+///
+MIMPI_Retcode MIMPI_Flush();
+
+/// @brief Starts sending data to the specified process.
+///
+/// Like @ref MIMPI_Send, but returns without waiting for the data to be
+/// written. @ref data must stay untouched until the request completes.
+///
+/// @param data - data to be sent.
+/// @param count - number of bytes of data to be sent.
+/// @param destination - rank of the process who is to receive the data.
+/// @param tag - a discriminant of the data, which can be used
+///              to distinguish between messages.
+/// @param request - place where handle of the operation is to be put.
+/// @return MIMPI return code:
+///         - `MIMPI_SUCCESS` if operation started successfully.
+///         - `MIMPI_ERROR_ATTEMPTED_SELF_OP` if process attempted to send to itself
+///         - `MIMPI_ERROR_NO_SUCH_RANK` if there is no process with rank
+///           @ref destination in the world.
+///         - `MIMPI_ERROR_REMOTE_FINISHED` if the process with rank
+///           @ref destination is known to have escaped _MPI block_.
+///         On error @ref request is set to `MIMPI_REQUEST_NULL`.
+///
+MIMPI_Retcode MIMPI_Isend(
+    void const *data,
+    int count,
+    int destination,
+    int tag,
+    MIMPI_Request *request
+);
+
+/// @brief Posts a receive of data from the specified process.
+///
+/// Like @ref MIMPI_Recv, but returns at once. Any number of receives can be
+/// posted at the same time; an arriving message is put in the earliest posted
+/// receive it matches. @ref data must stay untouched until the request completes.
+///
+/// @param data - place where received data is to be put.
+/// @param count - number of bytes of data to be received.
+/// @param source - rank of the process for data from we are waiting.
+/// @param tag - a discriminant of the data, which can be used
+///              to distinguish between messages.
+/// @param request - place where handle of the operation is to be put.
+/// @return MIMPI return code:
+///         - `MIMPI_SUCCESS` if operation started successfully.
+///         - `MIMPI_ERROR_ATTEMPTED_SELF_OP` if process attempted to receive from itself
+///         - `MIMPI_ERROR_NO_SUCH_RANK` if there is no process with rank
+///           @ref source in the world.
+///         On error @ref request is set to `MIMPI_REQUEST_NULL`.
+///
+MIMPI_Retcode MIMPI_Irecv(
+    void *data,
+    int count,
+    int source,
+    int tag,
+    MIMPI_Request *request
+);
+
+/// @brief Waits until the operation completes.
+///
+/// Releases the request and sets it to `MIMPI_REQUEST_NULL`.
+/// Returns at once for `MIMPI_REQUEST_NULL`.
+///
+/// @param request - handle of the operation.
+/// @return result of the operation, as the blocking counterpart would return.
+///         `MIMPI_ERROR_DEADLOCK_DETECTED` is reported only for a receive
+///         being waited for.
+///
+MIMPI_Retcode MIMPI_Wait(MIMPI_Request *request);
+
+/// @brief Waits until all the operations complete.
+///
+/// @param count - number of handles in @ref requests.
+/// @param requests - handles of the operations, `MIMPI_REQUEST_NULL` ones are skipped.
+/// @return the first unsuccessful result in order of @ref requests,
+///         `MIMPI_SUCCESS` if there is none.
+///
+MIMPI_Retcode MIMPI_Waitall(int count, MIMPI_Request requests[]);
+
+/// @brief Checks whether the operation has completed.
+///
+/// If it has, sets @ref flag and behaves like @ref MIMPI_Wait.
+/// Otherwise clears @ref flag and returns `MIMPI_SUCCESS`.
+///
+MIMPI_Retcode MIMPI_Test(MIMPI_Request *request, bool *flag);
+
+/// @brief Checks whether any of the operations has completed.
+///
+/// If one has, sets @ref flag, puts its position in @ref index and behaves
+/// like @ref MIMPI_Wait on it. If all handles are `MIMPI_REQUEST_NULL`,
+/// sets @ref flag and puts -1 in @ref index. Otherwise clears @ref flag.
+///
+MIMPI_Retcode MIMPI_Testany(int count, MIMPI_Request requests[], int *index, bool *flag);
+
+/// @brief Prepares a send to be started any number of times.
+///
+/// Checks the arguments like @ref MIMPI_Isend and binds them to a persistent
+/// request, which is inactive until started by @ref MIMPI_Start. Waiting for
+/// a started persistent request completes it, makes it inactive again and
+/// keeps the handle. Waiting for an inactive one returns `MIMPI_SUCCESS`
+/// at once. The request is released by @ref MIMPI_Request_free only.
+///
+/// @param request - place where handle of the request is to be put.
+/// @return MIMPI return code:
+///         - `MIMPI_SUCCESS` if the request got prepared.
+///         - `MIMPI_ERROR_ATTEMPTED_SELF_OP` if process attempted to send to itself
+///         - `MIMPI_ERROR_NO_SUCH_RANK` if there is no process with rank
+///           @ref destination in the world.
+///         On error @ref request is set to `MIMPI_REQUEST_NULL`.
+///
+MIMPI_Retcode MIMPI_Send_init(
+    void const *data,
+    int count,
+    int destination,
+    int tag,
+    MIMPI_Request *request
+);
+
+/// @brief Prepares a receive to be started any number of times.
+///
+/// Like @ref MIMPI_Send_init, for a receive as posted by @ref MIMPI_Irecv.
+///
+/// @return MIMPI return code, as for @ref MIMPI_Send_init, with @ref source
+///         in place of @ref destination.
+///
+MIMPI_Retcode MIMPI_Recv_init(
+    void *data,
+    int count,
+    int source,
+    int tag,
+    MIMPI_Request *request
+);
+
+/// @brief Starts an inactive persistent request.
+///
+/// The send or receive goes on as if just started by @ref MIMPI_Isend or
+/// @ref MIMPI_Irecv with the arguments bound to the request.
+///
+/// @return MIMPI return code:
+///         - `MIMPI_SUCCESS` if operation started successfully.
+///         - `MIMPI_ERROR_REMOTE_FINISHED` if the destination of a send
+///           is known to have escaped _MPI block_, the request stays inactive.
+///         - `MIMPI_ERROR_INVALID_ARGUMENT` if the request is `MIMPI_REQUEST_NULL`,
+///           not persistent or already active; it is left as it was.
+///
+MIMPI_Retcode MIMPI_Start(MIMPI_Request *request);
+
+/// @brief Starts inactive persistent requests one after another.
+///
+/// @return the first unsuccessful result of @ref MIMPI_Start in order
+///         of @ref requests, `MIMPI_SUCCESS` if there is none.
+///
+MIMPI_Retcode MIMPI_Startall(int count, MIMPI_Request requests[]);
+
+/// @brief Releases a request.
+///
+/// Waits for the request if it is active, releases it if it is persistent
+/// and sets it to `MIMPI_REQUEST_NULL`. Returns at once for `MIMPI_REQUEST_NULL`.
+///
+void MIMPI_Request_free(MIMPI_Request *request);
+
 /// @brief Synchronises all processes.
 ///
 /// Blocks execution of the calling process until all processes execute
@@ -162,6 +422,7 @@ MIMPI_Retcode MIMPI_Bcast(
 ///         - `MIMPI_SUCCESS` if operation ended successfully.
 ///         - `MIMPI_ERROR_NO_SUCH_RANK` if there is no process with rank
 ///           @ref root in the world.
+///         - `MIMPI_ERROR_INVALID_ARGUMENT` if @ref op is unknown.
 ///         - `MIMPI_ERROR_REMOTE_FINISHED` if any process in the world
 ///            has already escaped _MPI block_.
 ///         - `MIMPI_ERROR_DEADLOCK_DETECTED` if a deadlock has been detected
@@ -175,4 +436,363 @@ MIMPI_Retcode MIMPI_Reduce(
     int root
 );
 
+/// @brief Reduces typed data from all processes to one.
+///
+/// Like @ref MIMPI_Reduce, but reduces @ref count elements of type
+/// @ref datatype instead of @ref count bytes.
+///
+/// @param send_data - data to be reduced.
+/// @param recv_data - place where reduction's result is to be put.
+/// @param count - number of elements of data to be reduced.
+/// @param datatype - type of the elements.
+/// @param op - a particular operation to be performed for reduction.
+/// @param root - rank of the process who is to hold the result of reduction.
+///
+/// @return MIMPI return code, as for @ref MIMPI_Reduce, and
+///         `MIMPI_ERROR_INVALID_ARGUMENT` if @ref datatype or @ref op is unknown
+///         or @ref count elements do not fit in `INT_MAX` bytes.
+///
+MIMPI_Retcode MIMPI_Reduce_typed(
+    void const *send_data,
+    void *recv_data,
+    int count,
+    MIMPI_Datatype datatype,
+    MIMPI_Op op,
+    int root
+);
+
+/// @brief Reduces data from all processes to all processes.
+///
+/// Performs reduction of kind @ref op over @ref count bytes of data
+/// stored at address @ref send_data in every process. The reduction's result
+/// is put at @ref recv_data in every process. Additionally, is
+/// a synchronisation point similarly to @ref MIMPI_Barrier.
+///
+/// @param send_data - data to be reduced.
+/// @param recv_data - place where reduction's result is to be put.
+/// @param count - number of bytes of data to be reduced.
+/// @param op - a particular operation to be performed for reduction.
+///
+/// @return MIMPI return code:
+///         - `MIMPI_SUCCESS` if operation ended successfully.
+///         - `MIMPI_ERROR_INVALID_ARGUMENT` if @ref op is unknown.
+///         - `MIMPI_ERROR_REMOTE_FINISHED` if any process in the world
+///            has already escaped _MPI block_.
+///
+MIMPI_Retcode MIMPI_Allreduce(
+    void const *send_data,
+    void *recv_data,
+    int count,
+    MIMPI_Op op
+);
+
+/// @brief Reduces typed data from all processes to all processes.
+///
+/// Like @ref MIMPI_Allreduce, but reduces @ref count elements of type
+/// @ref datatype instead of @ref count bytes.
+///
+/// @return MIMPI return code, as for @ref MIMPI_Allreduce, and
+///         `MIMPI_ERROR_INVALID_ARGUMENT` as for @ref MIMPI_Reduce_typed.
+///
+MIMPI_Retcode MIMPI_Allreduce_typed(
+    void const *send_data,
+    void *recv_data,
+    int count,
+    MIMPI_Datatype datatype,
+    MIMPI_Op op
+);
+
+/// @brief Gathers data from all processes in one.
+///
+/// Every process contributes @ref count bytes from @ref send_data.
+/// The process with rank @ref root puts the block of rank `i` at
+/// `recv_data + i * count`, other processes do not touch @ref recv_data.
+/// Additionally, is a synchronisation point similarly to @ref MIMPI_Barrier.
+///
+/// @param send_data - block of the calling process.
+/// @param recv_data - place for blocks of all processes, in order of ranks.
+/// @param count - number of bytes of the block of every process.
+/// @param root - rank of the process which gathers the blocks.
+///
+/// @return MIMPI return code:
+///         - `MIMPI_SUCCESS` if operation ended successfully.
+///         - `MIMPI_ERROR_NO_SUCH_RANK` if there is no process with rank
+///           @ref root in the world.
+///         - `MIMPI_ERROR_REMOTE_FINISHED` if any process in the world
+///            has already escaped _MPI block_.
+///
+MIMPI_Retcode MIMPI_Gather(
+    void const *send_data,
+    void *recv_data,
+    int count,
+    int root
+);
+
+/// @brief Gathers blocks of different sizes from all processes in one.
+///
+/// Like @ref MIMPI_Gather, but the block of rank `i` has `recv_counts[i]`
+/// bytes and is put at `recv_data + displs[i]`. Every process has to pass
+/// the same @ref recv_counts, @ref displs matter only at @ref root.
+///
+/// @param count - number of bytes of the block of the calling process,
+///                equal to `recv_counts[rank]`.
+///
+/// @return MIMPI return code, as for @ref MIMPI_Gather, and
+///         `MIMPI_ERROR_INVALID_ARGUMENT` if @ref count is not `recv_counts[rank]`.
+///
+MIMPI_Retcode MIMPI_Gatherv(
+    void const *send_data,
+    int count,
+    void *recv_data,
+    int const *recv_counts,
+    int const *displs,
+    int root
+);
+
+/// @brief Scatters blocks of data from one process to all processes.
+///
+/// The process with rank @ref root sends the block at
+/// `send_data + i * count` to the process of rank `i`, which puts it at
+/// @ref recv_data. @ref send_data matters only at @ref root.
+/// Additionally, is a synchronisation point similarly to @ref MIMPI_Barrier.
+///
+/// @param send_data - blocks for all processes, in order of ranks.
+/// @param recv_data - place for the block of the calling process.
+/// @param count - number of bytes of the block of every process.
+/// @param root - rank of the process which scatters the blocks.
+///
+/// @return MIMPI return code, as for @ref MIMPI_Gather.
+///
+MIMPI_Retcode MIMPI_Scatter(
+    void const *send_data,
+    void *recv_data,
+    int count,
+    int root
+);
+
+/// @brief Scatters blocks of different sizes from one process to all.
+///
+/// Like @ref MIMPI_Scatter, but the block of rank `i` has `send_counts[i]`
+/// bytes and is taken from `send_data + displs[i]`. Every process has to pass
+/// the same @ref send_counts, @ref displs matter only at @ref root.
+///
+/// @param count - number of bytes of the block of the calling process,
+///                equal to `send_counts[rank]`.
+///
+/// @return MIMPI return code, as for @ref MIMPI_Gather, and
+///         `MIMPI_ERROR_INVALID_ARGUMENT` if @ref count is not `send_counts[rank]`.
+///
+MIMPI_Retcode MIMPI_Scatterv(
+    void const *send_data,
+    int const *send_counts,
+    int const *displs,
+    void *recv_data,
+    int count,
+    int root
+);
+
+/// @brief Gathers data from all processes in all processes.
+///
+/// Like @ref MIMPI_Gather, but every process gets blocks of all processes.
+///
+/// @return MIMPI return code:
+///         - `MIMPI_SUCCESS` if operation ended successfully.
+///         - `MIMPI_ERROR_REMOTE_FINISHED` if any process in the world
+///            has already escaped _MPI block_.
+///
+MIMPI_Retcode MIMPI_Allgather(
+    void const *send_data,
+    void *recv_data,
+    int count
+);
+
+/// @brief Gathers blocks of different sizes from all processes in all.
+///
+/// Like @ref MIMPI_Gatherv, but every process gets blocks of all processes,
+/// so @ref displs matter at every process.
+///
+/// @return MIMPI return code, as for @ref MIMPI_Allgather, and
+///         `MIMPI_ERROR_INVALID_ARGUMENT` if @ref count is not `recv_counts[rank]`.
+///
+MIMPI_Retcode MIMPI_Allgatherv(
+    void const *send_data,
+    int count,
+    void *recv_data,
+    int const *recv_counts,
+    int const *displs
+);
+
+/// @brief Exchanges blocks of data between all pairs of processes.
+///
+/// Every process sends the block at `send_data + i * count` to the process
+/// of rank `i`, which puts it at `recv_data + rank * count`.
+/// Additionally, is a synchronisation point similarly to @ref MIMPI_Barrier.
+///
+/// @param send_data - blocks for all processes, in order of ranks.
+/// @param recv_data - place for blocks from all processes, in order of ranks.
+/// @param count - number of bytes of every block.
+///
+/// @return MIMPI return code:
+///         - `MIMPI_SUCCESS` if operation ended successfully.
+///         - `MIMPI_ERROR_REMOTE_FINISHED` if any process in the world
+///            has already escaped _MPI block_.
+///
+MIMPI_Retcode MIMPI_Alltoall(
+    void const *send_data,
+    void *recv_data,
+    int count
+);
+
+/// @brief Exchanges blocks of different sizes between all pairs of processes.
+///
+/// Like @ref MIMPI_Alltoall, but the block for rank `i` has `send_counts[i]`
+/// bytes at `send_data + send_displs[i]`, and the block from rank `i` has
+/// `recv_counts[i]` bytes put at `recv_data + recv_displs[i]`. The sizes
+/// have to agree between each pair of processes.
+///
+/// @return MIMPI return code, as for @ref MIMPI_Alltoall.
+///
+MIMPI_Retcode MIMPI_Alltoallv(
+    void const *send_data,
+    int const *send_counts,
+    int const *send_displs,
+    void *recv_data,
+    int const *recv_counts,
+    int const *recv_displs
+);
+
+/// @brief Starts a barrier without waiting for it.
+///
+/// Non-blocking collectives are run in order of calls by a background
+/// thread of the process, so all processes have to start collectives,
+/// blocking or not, in the same order. A blocking collective first waits
+/// for all non-blocking ones started before it.
+///
+/// @param request - place where handle of the operation is to be put.
+/// @return `MIMPI_SUCCESS`; the result of the barrier, as @ref MIMPI_Barrier
+///         would return it, is given by @ref MIMPI_Wait on @ref request.
+///
+MIMPI_Retcode MIMPI_Ibarrier(MIMPI_Request *request);
+
+/// @brief Starts a broadcast without waiting for it.
+///
+/// Like @ref MIMPI_Bcast, see @ref MIMPI_Ibarrier for ordering.
+/// @ref data must stay untouched until the request completes.
+///
+/// @param request - place where handle of the operation is to be put.
+/// @return MIMPI return code:
+///         - `MIMPI_SUCCESS` if operation started successfully.
+///         - `MIMPI_ERROR_NO_SUCH_RANK` if there is no process with rank
+///           @ref root in the world.
+///         On error @ref request is set to `MIMPI_REQUEST_NULL`.
+///
+MIMPI_Retcode MIMPI_Ibcast(
+    void *data,
+    int count,
+    int root,
+    MIMPI_Request *request
+);
+
+/// @brief Starts a reduction without waiting for it.
+///
+/// Like @ref MIMPI_Reduce, see @ref MIMPI_Ibarrier for ordering.
+/// Neither buffer may be touched until the request completes.
+///
+/// @param request - place where handle of the operation is to be put.
+/// @return MIMPI return code, as for @ref MIMPI_Ibcast.
+///
+MIMPI_Retcode MIMPI_Ireduce(
+    void const *send_data,
+    void *recv_data,
+    int count,
+    MIMPI_Op op,
+    int root,
+    MIMPI_Request *request
+);
+
+/// @brief Splits the world into groups of processes.
+///
+/// Processes passing the same @ref color make up one communicator, ranked
+/// there in order of @ref key, ties broken by rank in the world.
+/// Is a collective of the whole world, like @ref MIMPI_Barrier.
+/// Collectives of a communicator involve only its members, so collectives
+/// of disjoint communicators run at the same time.
+///
+/// @param color - group of the process, or a negative number to join none.
+/// @param key - position of the process in its group.
+/// @param comm - place where the handle of the group is to be put,
+///               `MIMPI_COMM_NULL` for a negative @ref color or on error.
+/// @return MIMPI return code, as for @ref MIMPI_Barrier.
+///
+MIMPI_Retcode MIMPI_Comm_split(int color, int key, MIMPI_Comm *comm);
+
+/// @brief Releases the communicator and sets it to `MIMPI_COMM_NULL`.
+///
+/// Involves no other process. Returns at once for `MIMPI_COMM_NULL`.
+///
+void MIMPI_Comm_free(MIMPI_Comm *comm);
+
+/// @brief Returns the rank of the calling process in the communicator,
+/// -1 for `MIMPI_COMM_NULL`.
+int MIMPI_Comm_rank(MIMPI_Comm comm);
+
+/// @brief Returns the number of processes in the communicator,
+/// -1 for `MIMPI_COMM_NULL`.
+int MIMPI_Comm_size(MIMPI_Comm comm);
+
+/// @brief Synchronises all processes of the communicator.
+///
+/// Like @ref MIMPI_Barrier, restricted to members of @ref comm. Every member
+/// has to call collectives of a communicator in the same order.
+///
+/// @return MIMPI return code, as for @ref MIMPI_Barrier.
+///
+MIMPI_Retcode MIMPI_Comm_barrier(MIMPI_Comm comm);
+
+/// @brief Broadcasts data to all processes of the communicator.
+///
+/// Like @ref MIMPI_Bcast, restricted to members of @ref comm.
+/// @ref root is a rank in the communicator.
+///
+/// @return MIMPI return code, as for @ref MIMPI_Bcast.
+///
+MIMPI_Retcode MIMPI_Comm_bcast(
+    MIMPI_Comm comm,
+    void *data,
+    int count,
+    int root
+);
+
+/// @brief Reduces typed data from all processes of the communicator to one.
+///
+/// Like @ref MIMPI_Reduce_typed, restricted to members of @ref comm.
+/// @ref root is a rank in the communicator.
+///
+/// @return MIMPI return code, as for @ref MIMPI_Reduce_typed.
+///
+MIMPI_Retcode MIMPI_Comm_reduce(
+    MIMPI_Comm comm,
+    void const *send_data,
+    void *recv_data,
+    int count,
+    MIMPI_Datatype datatype,
+    MIMPI_Op op,
+    int root
+);
+
+/// @brief Reduces typed data from all processes of the communicator to all of them.
+///
+/// Like @ref MIMPI_Allreduce_typed, restricted to members of @ref comm.
+///
+/// @return MIMPI return code, as for @ref MIMPI_Allreduce_typed.
+///
+MIMPI_Retcode MIMPI_Comm_allreduce(
+    MIMPI_Comm comm,
+    void const *send_data,
+    void *recv_data,
+    int count,
+    MIMPI_Datatype datatype,
+    MIMPI_Op op
+);
+
 #endif /* MIMPI_H */
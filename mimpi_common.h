@@ -11,15 +11,34 @@
 #include <stdnoreturn.h>
 
 
-#define ZEROFD 964
-#define GR_ROOT_IN 994
-#define GR_ROOT_OUT 995
-#define GR_LEFT_IN 996
-#define GR_LEFT_OUT 997
-#define GR_RIGHT_IN 998
-#define GR_RIGHT_OUT 999
-#define GR_DATA_IN 1000
-#define GR_DATA_OUT 1001
+// MIMPI may only use descriptors from [MIMPI_FD_MIN, MIMPI_FD_MAX].
+// Group descriptors have fixed numbers at the top of this range, below them
+// there are two blocks of (world_size - 1) descriptors each, in order:
+// p-p in, p-p out. The lowest one is ZEROFD(world_size).
+// Descriptors the library opens for itself (e.g. epoll instances) are moved
+// to [MIMPI_FD_MIN, ZEROFD(world_size)), which has room for MIMPI_PRIVATE_FDS.
+#define MIMPI_FD_MIN 20
+#define MIMPI_PRIVATE_FDS 32
+#define MIMPI_FD_MAX 1023
+#define GR_ROOT_IN 1016
+#define GR_ROOT_OUT 1017
+#define GR_LEFT_IN 1018
+#define GR_LEFT_OUT 1019
+#define GR_RIGHT_IN 1020
+#define GR_RIGHT_OUT 1021
+#define ZEROFD(n) (GR_ROOT_IN - 2 * ((n) - 1))
+#define MIMPI_MAX_WORLD_SIZE ((GR_ROOT_IN - MIMPI_FD_MIN - MIMPI_PRIVATE_FDS) / 2 + 1)
+
+// Optional shared memory transport. If MIMPI_SHM_VAR holds a ring size,
+// mimpirun creates one shared memory file with a ring buffer per ordered pair
+// of processes and hands it to every process as MIMPI_SHM_FD. The ring from
+// j to i is the (i * n + j)-th one, each ring is MIMPI_SHM_HEADER bytes of
+// positions followed by data.
+#define MIMPI_SHM_VAR "MIMPI_SHM_RING"
+#define MIMPI_SHM_FD 1023
+#define MIMPI_SHM_HEADER 128
+#define MIMPI_SHM_MIN_RING 4096
+#define MIMPI_SHM_MAX_RING (64 << 20)
 
 /*
     Assert that expression doesn't evaluate to -1 (as almost every system function does in case of error).
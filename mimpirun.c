@@ -2,43 +2,129 @@
  * This file is for implementation of mimpirun program.
  * */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
 #include "mimpi_common.h"
 #include "channel.h"
 
+// Until both ends of a p-p channel are forked, mimpirun keeps one descriptor
+// of each direction, which for n processes peaks at about n*n/2 descriptors.
+static rlim_t fds_held(int n) {
+    return (rlim_t)n * n / 2 + 8 * (rlim_t)n;
+}
+
+// Moves a descriptor lying in the range children dup2 to above the range
+// used by MIMPI, so that dup2 never overwrites one that is still needed.
+static int relocate_fd(int fd, int n) {
+    if (fd < ZEROFD(n)) {
+        return fd;
+    }
+    int moved = fcntl(fd, F_DUPFD, MIMPI_FD_MAX + 1);
+    ASSERT_SYS_OK(moved);
+    ASSERT_SYS_OK(close(fd));
+    return moved;
+}
+
+static void open_channel(int pipefd[2], int n) {
+    ASSERT_SYS_OK(channel(pipefd));
+    pipefd[0] = relocate_fd(pipefd[0], n);
+    pipefd[1] = relocate_fd(pipefd[1], n);
+}
+
+// Descriptors of small worlds fit below the range children dup2 to,
+// larger ones need room above it.
+static void raise_fd_limit(int n) {
+    if (MIMPI_FD_MIN + fds_held(n) <= (rlim_t)ZEROFD(n)) {
+        return;
+    }
+    struct rlimit lim;
+    ASSERT_SYS_OK(getrlimit(RLIMIT_NOFILE, &lim));
+    rlim_t needed = MIMPI_FD_MAX + 1 + fds_held(n);
+    if (lim.rlim_cur >= needed) {
+        return;
+    }
+    if (lim.rlim_max != RLIM_INFINITY && lim.rlim_max < needed) {
+        fatal("%d processes need %lu file descriptors, limit is %lu",
+              n, (unsigned long)needed, (unsigned long)lim.rlim_max);
+    }
+    lim.rlim_cur = needed;
+    ASSERT_SYS_OK(setrlimit(RLIMIT_NOFILE, &lim));
+}
+
+// Returns the ring size requested for the shared memory transport,
+// rounded up to a power of two, or 0 if the transport is off.
+static size_t shm_ring_size() {
+    const char* ring_str = getenv(MIMPI_SHM_VAR);
+    if (ring_str == NULL || atol(ring_str) <= 0) {
+        return 0;
+    }
+    size_t wanted = atol(ring_str);
+    size_t ring = MIMPI_SHM_MIN_RING;
+    while (ring < wanted && ring < MIMPI_SHM_MAX_RING) {
+        ring *= 2;
+    }
+    return ring;
+}
+
+// Creates the shared memory file of all rings, see mimpi_common.h.
+static int open_shm(int n, size_t ring) {
+    int fd = memfd_create("mimpi_shm", 0);
+    ASSERT_SYS_OK(fd);
+    ASSERT_SYS_OK(ftruncate(fd, (off_t)n * n * (MIMPI_SHM_HEADER + ring)));
+    return relocate_fd(fd, n);
+}
+
 int main(int argc, char** argv) {
+    if (argc < 3) {
+        fatal("Usage: %s N PROGRAM [ARGS...]", argv[0]);
+    }
     int n = atoi(argv[1]);
+    if (n < 1 || n > MIMPI_MAX_WORLD_SIZE) {
+        fatal("number of processes must be between 1 and %d", MIMPI_MAX_WORLD_SIZE);
+    }
+    raise_fd_limit(n);
     ASSERT_SYS_OK(setenv("MIMPI_WORLD_SIZE", argv[1], 1));
-    int ppchannels[16][16][2];
-    for (int i = 0; i < n; i++) {
-        for (int j = 0; j < n; j++) {
-            ppchannels[i][j][0] = -1;
-            ppchannels[i][j][1] = -1;
-        }
+
+    int shmfd = -1;
+    size_t ring = shm_ring_size();
+    if (ring > 0) {
+        shmfd = open_shm(n, ring);
+        char ring_string[24];
+        snprintf(ring_string, sizeof ring_string, "%zu", ring);
+        ASSERT_SYS_OK(setenv(MIMPI_SHM_VAR, ring_string, 1));
+    }
+    else {
+        ASSERT_SYS_OK(unsetenv(MIMPI_SHM_VAR));
     }
 
-    int grdatachannels[16][2];
-    for (int i = 0; i < n; i++) {
-        ASSERT_SYS_OK(channel(grdatachannels[i]));
+    // ppchannels[i * n + j] is the channel from j to i
+    int (*ppchannels)[2] = malloc((size_t)n * n * sizeof(*ppchannels));
+    int (*grchannels)[2][2] = malloc(n * sizeof(*grchannels));
+    assert(ppchannels != NULL && grchannels != NULL);
+    for (int i = 0; i < n * n; i++) {
+        ppchannels[i][0] = -1;
+        ppchannels[i][1] = -1;
     }
 
-    int grchannels[15][2][2];
     for (int i = 0; i < n-1; i++) {
-        ASSERT_SYS_OK(channel(grchannels[i][0]));
-        ASSERT_SYS_OK(channel(grchannels[i][1]));
+        open_channel(grchannels[i][0], n);
+        open_channel(grchannels[i][1], n);
     }
 
     for (int i = 0; i < n; i++) {
         for (int j = 0; j < n; j++) {
             if (i != j) {
-                if (ppchannels[i][j][0] == -1) {
-                    ASSERT_SYS_OK(channel(ppchannels[i][j]));
+                if (ppchannels[i * n + j][0] == -1) {
+                    open_channel(ppchannels[i * n + j], n);
                 }
-                if (ppchannels[j][i][0] == -1) {
-                    ASSERT_SYS_OK(channel(ppchannels[j][i]));
+                if (ppchannels[j * n + i][0] == -1) {
+                    open_channel(ppchannels[j * n + i], n);
                 }
             }
         }
@@ -46,12 +132,12 @@ int main(int argc, char** argv) {
         pid_t id = fork();
 
         if (!id) {
-            int fd1 = ZEROFD;
+            int fd1 = ZEROFD(n);
             int fd2 = fd1 + n - 1;
             for (int k = 0; k < n; k++) {
                 if (i != k) {
-                    ASSERT_SYS_OK(dup2(ppchannels[i][k][0], fd1++));
-                    ASSERT_SYS_OK(dup2(ppchannels[k][i][1], fd2++));
+                    ASSERT_SYS_OK(dup2(ppchannels[i * n + k][0], fd1++));
+                    ASSERT_SYS_OK(dup2(ppchannels[k * n + i][1], fd2++));
                 }
             }
 
@@ -72,20 +158,10 @@ int main(int argc, char** argv) {
                 ASSERT_SYS_OK(dup2(grchannels[rightc-2][0][1], GR_RIGHT_OUT));
             }
 
-            fd1 = GR_DATA_OUT;
-            ASSERT_SYS_OK(dup2(grdatachannels[i][0], GR_DATA_IN));
-            for (int j = 0; j < n; j++) {
-                if (j != i) {
-                    ASSERT_SYS_OK(dup2(grdatachannels[j][1], fd1++));
-                }
-            }
-
-            for (int j = 0; j < n; j++) {
-                for (int k = 0; k < n; k++) {
-                    if (ppchannels[j][k][0] != -1) {
-                        close(ppchannels[j][k][0]);
-                        close(ppchannels[j][k][1]);
-                    }
+            for (int j = 0; j < n * n; j++) {
+                if (ppchannels[j][0] != -1) {
+                    close(ppchannels[j][0]);
+                    close(ppchannels[j][1]);
                 }
             }
 
@@ -96,12 +172,12 @@ int main(int argc, char** argv) {
                 ASSERT_SYS_OK(close(grchannels[j][1][1]));
             }
 
-            for (int j = 0; j < n; j++) {
-                ASSERT_SYS_OK(close(grdatachannels[j][0]));
-                ASSERT_SYS_OK(close(grdatachannels[j][1]));
+            if (shmfd != -1) {
+                ASSERT_SYS_OK(dup2(shmfd, MIMPI_SHM_FD));
+                ASSERT_SYS_OK(close(shmfd));
             }
 
-            char rank_string[3];
+            char rank_string[12];
             int retr = snprintf(rank_string, sizeof rank_string, "%d", i);
             if (retr < 0 || retr >= (int)sizeof(rank_string))
                 fatal("snprintf failed");
@@ -112,8 +188,8 @@ int main(int argc, char** argv) {
         else {
             for (int k = 0; k < n; k++) {
                 if (i != k) {
-                    ASSERT_SYS_OK(close(ppchannels[i][k][0]));
-                    ASSERT_SYS_OK(close(ppchannels[k][i][1]));
+                    ASSERT_SYS_OK(close(ppchannels[i * n + k][0]));
+                    ASSERT_SYS_OK(close(ppchannels[k * n + i][1]));
 
                 }
             }
@@ -127,11 +203,13 @@ int main(int argc, char** argv) {
         ASSERT_SYS_OK(close(grchannels[i][1][1]));
     }
 
-    for (int i = 0; i < n; i++) {
-        ASSERT_SYS_OK(close(grdatachannels[i][0]));
-        ASSERT_SYS_OK(close(grdatachannels[i][1]));
+    if (shmfd != -1) {
+        ASSERT_SYS_OK(close(shmfd));
     }
 
+    free(ppchannels);
+    free(grchannels);
+
     ASSERT_SYS_OK(unsetenv("MIMPI_WORLD_SIZE"));
     ASSERT_SYS_OK(unsetenv("MIMPI_RANK"));
 
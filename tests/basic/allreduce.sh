@@ -0,0 +1,10 @@
+#!/bin/bash
+set -e
+./run_test 5 1 examples_build/allreduce 100
+./run_test 5 2 examples_build/allreduce 7
+./run_test 10 7 examples_build/allreduce 20000
+for alg in binomial kary ring; do
+    MIMPI_COLL_ALG=$alg ./run_test 10 7 examples_build/allreduce 3
+    MIMPI_COLL_ALG=$alg ./run_test 10 7 examples_build/allreduce 20000
+done
+MIMPI_COLL_ALG=ring ./run_test 20 16 examples_build/allreduce 300000
@@ -0,0 +1,8 @@
+#!/bin/bash
+set -e
+./run_test 5 1 examples_build/alltoall 10
+./run_test 5 5 examples_build/alltoall 1000
+./run_test 5 8 examples_build/alltoall 1000
+# blocks far above pipe capacity
+./run_test 20 6 examples_build/alltoall 300000
+./run_test 20 16 examples_build/alltoall 100000
@@ -0,0 +1,9 @@
+#!/bin/bash
+set -e
+./run_test 5 1 examples_build/any_source
+./run_test 5 2 examples_build/any_source 2 100
+./run_test 10 8 examples_build/any_source 100 50
+./run_test 10 5 examples_build/any_source 100000 10
+MIMPI_RENDEZVOUS_THRESHOLD=4096 ./run_test 10 5 examples_build/any_source 100000 10
+MIMPI_BATCH_SIZE=4096 ./run_test 10 5 examples_build/any_source 16 200
+./run_test 10 5 examples_build/any_source 100 50 1
@@ -0,0 +1,5 @@
+#!/bin/bash
+set -e
+./run_test 5 2 examples_build/any_tag_queue
+./run_test 5 2 examples_build/any_tag_queue 1
+MIMPI_BATCH_SIZE=4096 ./run_test 5 2 examples_build/any_tag_queue
@@ -0,0 +1,11 @@
+#!/bin/bash
+set -e
+./run_test 5 1 examples_build/batch 100
+./run_test 10 4 examples_build/batch 1000
+for size in 1 600 65536; do
+    MIMPI_BATCH_SIZE=$size ./run_test 5 1 examples_build/batch 100
+    MIMPI_BATCH_SIZE=$size ./run_test 10 2 examples_build/batch 1000
+    MIMPI_BATCH_SIZE=$size ./run_test 10 5 examples_build/batch 1000 1
+done
+MIMPI_BATCH_SIZE=4096 ./run_test 10 7 examples_build/sendrecv 300000 1
+MIMPI_BATCH_SIZE=4096 ./run_test 10 7 examples_build/icollectives 100
@@ -0,0 +1,4 @@
+#!/bin/bash
+set -e
+./run_test 10 64 examples_build/big_world
+./run_test 20 128 examples_build/big_world
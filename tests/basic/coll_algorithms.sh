@@ -0,0 +1,15 @@
+#!/bin/bash
+set -e
+for alg in binomial kary ring "barrier=dissemination,bcast=ring,reduce=binomial"; do
+    export MIMPI_COLL_ALG=$alg
+    ./run_test 2 16 examples_build/barrier
+    ./run_test 1 4 examples_build/barrier_remote_finish
+    ./run_test 3 5 examples_build/broken_barrier 3
+    for root in 0 4 9; do
+        ./run_test 10 10 examples_build/brodcast_any_size 70000 $root
+        ./run_test 10 10 examples_build/reduce_any_size 70000 $root
+    done
+    ./run_test 10 7 examples_build/reduce_typed
+done
+MIMPI_COLL_ALG=kary MIMPI_COLL_KARY=3 ./run_test 10 13 examples_build/brodcast_any_size 1000 5
+MIMPI_COLL_ALG=kary MIMPI_COLL_KARY=3 ./run_test 10 13 examples_build/reduce_any_size 1000 5
@@ -0,0 +1,10 @@
+#!/bin/bash
+set -e
+./run_test 5 1 examples_build/comm_split 1 100
+./run_test 5 2 examples_build/comm_split 2 7
+./run_test 10 9 examples_build/comm_split 3 20000
+./run_test 10 7 examples_build/comm_split 4 1000
+for alg in kary ring; do
+    MIMPI_COLL_ALG=$alg ./run_test 10 7 examples_build/comm_split 2 3
+    MIMPI_COLL_ALG=$alg ./run_test 10 8 examples_build/comm_split 3 20000
+done
@@ -0,0 +1,12 @@
+#!/bin/bash
+set -e
+./run_test 5 1 examples_build/gather 10 0
+./run_test 5 2 examples_build/gather 100 1
+for root in 0 3 8; do
+    ./run_test 10 13 examples_build/gather 1000 $root
+done
+./run_test 10 16 examples_build/gather 50000 5
+for alg in binomial kary ring; do
+    MIMPI_COLL_ALG=$alg ./run_test 10 13 examples_build/gather 1000 3
+    MIMPI_COLL_ALG=$alg ./run_test 10 13 examples_build/gather 50000 12
+done
@@ -0,0 +1,9 @@
+#!/bin/bash
+set -e
+./run_test 5 1 examples_build/icollectives 100
+./run_test 5 2 examples_build/icollectives 7
+./run_test 10 7 examples_build/icollectives 20000
+for alg in binomial ring; do
+    MIMPI_COLL_ALG=$alg ./run_test 10 7 examples_build/icollectives 3
+    MIMPI_COLL_ALG=$alg ./run_test 10 7 examples_build/icollectives 20000
+done
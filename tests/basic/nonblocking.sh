@@ -0,0 +1,5 @@
+#!/bin/bash
+set -e
+./run_test 5 2 examples_build/nonblocking
+./run_test 10 8 examples_build/nonblocking
+MIMPI_PROGRESS_THREADS=3 ./run_test 10 8 examples_build/nonblocking
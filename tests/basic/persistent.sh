@@ -0,0 +1,9 @@
+#!/bin/bash
+set -e
+./run_test 5 1 examples_build/persistent 100
+./run_test 5 2 examples_build/persistent 7 50
+./run_test 10 7 examples_build/persistent 100000 20
+./run_test 10 7 examples_build/persistent 1000 50 1
+MIMPI_RENDEZVOUS_THRESHOLD=4096 ./run_test 10 5 examples_build/persistent 100000 20
+MIMPI_RENDEZVOUS_THRESHOLD=4096 ./run_test 10 5 examples_build/persistent 100000 20 1
+MIMPI_BATCH_SIZE=4096 ./run_test 10 5 examples_build/persistent 16 100
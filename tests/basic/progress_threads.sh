@@ -0,0 +1,4 @@
+#!/bin/bash
+set -e
+MIMPI_PROGRESS_THREADS=3 ./run_test 2 8 examples_build/writers_reader
+MIMPI_PROGRESS_THREADS=4 ./run_test 100 16 examples_build/lot_of_messages
@@ -0,0 +1,4 @@
+#!/bin/bash
+set -e
+./run_test 5 2 examples_build/reduce_typed
+./run_test 10 5 examples_build/reduce_typed
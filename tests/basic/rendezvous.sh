@@ -0,0 +1,7 @@
+#!/bin/bash
+set -e
+MIMPI_RENDEZVOUS_THRESHOLD=65536 ./run_test 10 3 examples_build/rendezvous
+MIMPI_RENDEZVOUS_THRESHOLD=65536 MIMPI_SHM_RING=65536 ./run_test 10 3 examples_build/rendezvous
+MIMPI_RENDEZVOUS_THRESHOLD=1024 ./run_test 10 8 examples_build/nonblocking
+MIMPI_RENDEZVOUS_THRESHOLD=1024 ./run_test 5 2 examples_build/deadlock5
+MIMPI_RENDEZVOUS_THRESHOLD=1024 ./run_test 5 2 examples_build/deadlock6
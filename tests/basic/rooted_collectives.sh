@@ -0,0 +1,6 @@
+#!/bin/bash
+set -e
+for root in 0 1 6 11 12; do
+    ./run_test 10 13 examples_build/brodcast_any_size 70000 $root
+    ./run_test 10 13 examples_build/reduce_any_size 70000 $root
+done
@@ -0,0 +1,6 @@
+#!/bin/bash
+set -e
+for size in 32767 32768 32769 1000000; do
+    ./run_test 10 7 examples_build/reduce_any_size $size 0
+    ./run_test 10 7 examples_build/reduce_any_size $size 4
+done
@@ -0,0 +1,7 @@
+#!/bin/bash
+set -e
+./run_test 5 1 examples_build/sendrecv 100
+./run_test 5 2 examples_build/sendrecv 7
+./run_test 10 7 examples_build/sendrecv 300000
+./run_test 10 7 examples_build/sendrecv 300000 1
+./run_test 10 16 examples_build/sendrecv 1000 1
@@ -0,0 +1,7 @@
+#!/bin/bash
+set -e
+MIMPI_SHM_RING=4096 ./run_test 2 2 examples_build/big_message
+MIMPI_SHM_RING=65536 ./run_test 1 7 examples_build/obstruction
+MIMPI_SHM_RING=65536 ./run_test 10 8 examples_build/nonblocking
+MIMPI_SHM_RING=1048576 MIMPI_PROGRESS_THREADS=2 ./run_test 100 16 examples_build/lot_of_messages
+MIMPI_SHM_RING=65536 ./run_test 10 4 examples_build/batch 1000